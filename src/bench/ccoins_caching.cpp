@@ -4,6 +4,7 @@
 
 #include <bench/bench.h>
 #include <coins.h>
+#include <hash.h>
 #include <policy/policy.h>
 #include <wallet/crypter.h>
 
@@ -86,3 +87,31 @@ static void CCoinsCaching(benchmark::State& state)
 }
 
 BENCHMARK(CCoinsCaching, 170 * 1000);
+
+// Microbenchmark for the CCoinsMap of a cache: add a block's worth of coins,
+// look all of them up, and spend them again.
+static void CCoinsCacheAddSpend(benchmark::State& state)
+{
+    std::vector<COutPoint> outpoints;
+    for (uint32_t i = 0; i < 5000; i++) {
+        outpoints.emplace_back(Hash(&i, &i + 1), i % 4);
+    }
+    const CTxOut txout(50 * COIN, CScript() << OP_TRUE);
+    CCoinsView coinsDummy;
+
+    while (state.KeepRunning()) {
+        CCoinsViewCache coins(&coinsDummy);
+        for (const COutPoint& outpoint : outpoints) {
+            coins.AddCoin(outpoint, Coin(txout, 1, false), false);
+        }
+        for (const COutPoint& outpoint : outpoints) {
+            assert(!coins.AccessCoin(outpoint).IsSpent());
+        }
+        for (const COutPoint& outpoint : outpoints) {
+            coins.SpendCoin(outpoint);
+        }
+        assert(coins.GetCacheSize() == 0);
+    }
+}
+
+BENCHMARK(CCoinsCacheAddSpend, 100);
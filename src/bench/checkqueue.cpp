@@ -5,6 +5,7 @@
 #include <bench/bench.h>
 #include <util/system.h>
 #include <checkqueue.h>
+#include <crypto/sha256.h>
 #include <prevector.h>
 #include <vector>
 #include <boost/thread/thread.hpp>
@@ -59,3 +60,60 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.join_all();
 }
 BENCHMARK(CCheckQueueSpeedPrevectorJob, 1400);
+
+// This Benchmark measures how the CheckQueue scales with the number of worker
+// threads, with checks that each do a small, fixed amount of hashing (roughly
+// the cost of a signature cache lookup) so that the queue overhead shows.
+static void CCheckQueueScaling(benchmark::State& state, int nThreads)
+{
+    struct HashJob {
+        uint32_t n{0};
+        HashJob() {}
+        explicit HashJob(uint32_t nIn) : n(nIn) {}
+        bool operator()()
+        {
+            unsigned char buf[CSHA256::OUTPUT_SIZE] = {};
+            for (int i = 0; i < 16; i++) {
+                CSHA256().Write((const unsigned char*)&n, sizeof(n)).Write(buf, sizeof(buf)).Finalize(buf);
+            }
+            return buf[0] != 0 || buf[1] != 0 || n != 0xffffffff;
+        }
+        void swap(HashJob& x) { std::swap(n, x.n); };
+    };
+    CCheckQueue<HashJob> queue {QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    // The master thread is the first worker.
+    for (auto x = 0; x < nThreads - 1; ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<HashJob> control(&queue);
+        std::vector<std::vector<HashJob>> vBatches(BATCHES);
+        uint32_t n = 0;
+        for (auto& vChecks : vBatches) {
+            vChecks.reserve(BATCH_SIZE);
+            for (size_t x = 0; x < BATCH_SIZE; ++x)
+                vChecks.emplace_back(n++);
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static void CCheckQueueScaling1Thread(benchmark::State& state) { CCheckQueueScaling(state, 1); }
+static void CCheckQueueScaling2Threads(benchmark::State& state) { CCheckQueueScaling(state, 2); }
+static void CCheckQueueScaling4Threads(benchmark::State& state) { CCheckQueueScaling(state, 4); }
+static void CCheckQueueScaling8Threads(benchmark::State& state) { CCheckQueueScaling(state, 8); }
+static void CCheckQueueScaling16Threads(benchmark::State& state) { CCheckQueueScaling(state, 16); }
+static void CCheckQueueScaling32Threads(benchmark::State& state) { CCheckQueueScaling(state, 32); }
+static void CCheckQueueScaling64Threads(benchmark::State& state) { CCheckQueueScaling(state, 64); }
+
+BENCHMARK(CCheckQueueScaling1Thread, 40);
+BENCHMARK(CCheckQueueScaling2Threads, 40);
+BENCHMARK(CCheckQueueScaling4Threads, 40);
+BENCHMARK(CCheckQueueScaling8Threads, 40);
+BENCHMARK(CCheckQueueScaling16Threads, 40);
+BENCHMARK(CCheckQueueScaling32Threads, 40);
+BENCHMARK(CCheckQueueScaling64Threads, 40);
@@ -0,0 +1,104 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <policy/policy.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <vector>
+
+static void AddTx(const CTransactionRef& tx, CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
+{
+    int64_t nTime = 0;
+    unsigned int nHeight = 1;
+    bool spendsCoinbase = false;
+    unsigned int sigOpCost = 4;
+    LockPoints lp;
+    pool.addUnchecked(CTxMemPoolEntry(tx, 1000, nTime, nHeight, spendsCoinbase, sigOpCost, lp));
+}
+
+static CTransactionRef MakeTx(const std::vector<COutPoint>& prevouts, size_t num_outputs)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(prevouts.size());
+    for (size_t i = 0; i < prevouts.size(); ++i) {
+        tx.vin[i].prevout = prevouts[i];
+        tx.vin[i].scriptSig = CScript() << OP_1;
+    }
+    tx.vout.resize(num_outputs);
+    for (CTxOut& out : tx.vout) {
+        out.scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        out.nValue = 10 * COIN;
+    }
+    return MakeTransactionRef(tx);
+}
+
+// Accept a long chain of unconfirmed transactions one at a time, which walks
+// all ancestors of each new transaction, then remove it again from the root.
+static void MempoolLongChain(benchmark::State& state)
+{
+    constexpr size_t CHAIN_LENGTH = 500;
+
+    std::vector<CTransactionRef> chain;
+    COutPoint prevout(uint256S("01"), 0);
+    for (size_t i = 0; i < CHAIN_LENGTH; ++i) {
+        chain.push_back(MakeTx({prevout}, 1));
+        prevout = COutPoint(chain.back()->GetHash(), 0);
+    }
+
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    while (state.KeepRunning()) {
+        for (const CTransactionRef& tx : chain) {
+            AddTx(tx, pool);
+        }
+        pool.removeRecursive(*chain.front());
+        assert(pool.size() == 0);
+    }
+}
+
+// Re-add the transactions of a disconnected block after their wide trees of
+// descendants are in the mempool already, like after a reorg, which walks
+// all descendants of each block transaction.
+static void MempoolReorgFanOut(benchmark::State& state)
+{
+    constexpr size_t NUM_BLOCK_TXS = 10;
+    constexpr size_t FAN_OUT = 100;
+
+    std::vector<CTransactionRef> block_txs, descendants;
+    for (size_t i = 0; i < NUM_BLOCK_TXS; ++i) {
+        block_txs.push_back(MakeTx({COutPoint(uint256S("01"), i)}, FAN_OUT));
+        for (size_t j = 0; j < FAN_OUT; ++j) {
+            descendants.push_back(MakeTx({COutPoint(block_txs.back()->GetHash(), j)}, 2));
+            // Every child has a grandchild that also spends from the next block transaction
+            std::vector<COutPoint> prevouts{COutPoint(descendants.back()->GetHash(), 0)};
+            if (i > 0) prevouts.emplace_back(block_txs[i - 1]->GetHash(), j);
+            descendants.push_back(MakeTx(prevouts, 1));
+        }
+    }
+    std::vector<uint256> block_hashes;
+    for (const CTransactionRef& tx : block_txs) {
+        block_hashes.push_back(tx->GetHash());
+    }
+
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    while (state.KeepRunning()) {
+        for (const CTransactionRef& tx : descendants) {
+            AddTx(tx, pool);
+        }
+        for (const CTransactionRef& tx : block_txs) {
+            AddTx(tx, pool);
+        }
+        pool.UpdateTransactionsFromBlock(block_hashes);
+        for (const CTransactionRef& tx : block_txs) {
+            pool.removeRecursive(*tx);
+        }
+        assert(pool.size() == 0);
+    }
+}
+
+BENCHMARK(MempoolLongChain, 2);
+BENCHMARK(MempoolReorgFanOut, 20);
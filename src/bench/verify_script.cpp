@@ -105,4 +105,46 @@ static void VerifyScriptBench(benchmark::State& state)
     }
 }
 
+// Microbenchmark for the legacy SIGHASH_ALL signature hashes of all inputs
+// of a large consolidation transaction, with and without the precomputed
+// transaction data.
+static void LegacySighash(benchmark::State& state, bool fCache)
+{
+    const CScript scriptCode = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 0) << OP_EQUALVERIFY << OP_CHECKSIG;
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(1000);
+    for (size_t i = 0; i < txSpend.vin.size(); i++) {
+        txSpend.vin[i].prevout = COutPoint(uint256(), i);
+        // Typical P2PKH scriptSig: a signature and a compressed public key.
+        txSpend.vin[i].scriptSig = CScript() << std::vector<unsigned char>(72, 0) << std::vector<unsigned char>(33, 0);
+    }
+    txSpend.vout.resize(2);
+    const CTransaction tx(txSpend);
+
+    while (state.KeepRunning()) {
+        if (fCache) {
+            const PrecomputedTransactionData txdata(tx);
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
+                SignatureHash(scriptCode, tx, i, SIGHASH_ALL, 0, SigVersion::BASE, &txdata);
+            }
+        } else {
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
+                SignatureHash(scriptCode, tx, i, SIGHASH_ALL, 0, SigVersion::BASE);
+            }
+        }
+    }
+}
+
+static void LegacySighashUncached(benchmark::State& state)
+{
+    LegacySighash(state, false);
+}
+
+static void LegacySighashCached(benchmark::State& state)
+{
+    LegacySighash(state, true);
+}
+
 BENCHMARK(VerifyScriptBench, 6300);
+BENCHMARK(LegacySighashUncached, 10);
+BENCHMARK(LegacySighashCached, 20);
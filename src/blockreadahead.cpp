@@ -0,0 +1,84 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockreadahead.h>
+
+#include <consensus/validation.h>
+#include <validation.h>
+
+#include <algorithm>
+
+void CBlockReadAhead::Process(Job& job)
+{
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    if (!ReadBlockFromDisk(*pblock, job.pos, job.params) || pblock->GetHash() != job.hash) {
+        return;
+    }
+    // The result is cached in fChecked; on failure the check is simply
+    // repeated when the block is connected.
+    CValidationState state;
+    CheckBlock(*pblock, state, job.params);
+    job.block = std::move(pblock);
+}
+
+std::shared_ptr<CBlockReadAhead::Job> CBlockReadAhead::NextJob()
+{
+    for (const auto& job : window) {
+        if (!job->fStarted) return job;
+    }
+    return nullptr;
+}
+
+void CBlockReadAhead::Thread()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (true) {
+        std::shared_ptr<Job> job;
+        while (!(job = NextJob())) {
+            condWorker.wait(lock);
+        }
+        job->fStarted = true;
+        lock.unlock();
+        Process(*job);
+        lock.lock();
+        job->fDone = true;
+        condMaster.notify_all();
+    }
+}
+
+void CBlockReadAhead::SetWindow(const std::vector<std::pair<uint256, FlatFilePos>>& blocks, const Consensus::Params& params)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    std::vector<std::shared_ptr<Job>> windowNew;
+    windowNew.reserve(blocks.size());
+    for (const auto& block : blocks) {
+        auto it = std::find_if(window.begin(), window.end(), [&block](const std::shared_ptr<Job>& job) { return job->hash == block.first; });
+        if (it != window.end()) {
+            // Copy rather than move, as the old window is searched again for the next block.
+            windowNew.push_back(*it);
+        } else {
+            windowNew.push_back(std::make_shared<Job>(block.first, block.second, params));
+        }
+    }
+    window.swap(windowNew);
+    if (NextJob()) condWorker.notify_all();
+}
+
+std::shared_ptr<const CBlock> CBlockReadAhead::Get(const uint256& hash, const FlatFilePos& pos, const Consensus::Params& params)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    auto it = std::find_if(window.begin(), window.end(), [&hash](const std::shared_ptr<Job>& job) { return job->hash == hash; });
+    std::shared_ptr<Job> job = it != window.end() ? *it : std::make_shared<Job>(hash, pos, params);
+    if (!job->fStarted) {
+        job->fStarted = true;
+        lock.unlock();
+        Process(*job);
+        lock.lock();
+        job->fDone = true;
+    }
+    while (!job->fDone) {
+        condMaster.wait(lock);
+    }
+    return job->block;
+}
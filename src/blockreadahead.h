@@ -0,0 +1,87 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKREADAHEAD_H
+#define BITCOIN_BLOCKREADAHEAD_H
+
+#include <flatfile.h>
+#include <primitives/block.h>
+#include <uint256.h>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace Consensus {
+struct Params;
+}
+
+/**
+ * Pool of worker threads that read blocks which are about to be connected
+ * from disk, and run the context-free CheckBlock on them.
+ *
+ * One thread (the master, holding cs_main) sets the window of blocks that
+ * follow the one it is connecting; the workers read, deserialize and check
+ * them in order, so that by the time the master gets to a block, it only has
+ * to be connected. A block that passed CheckBlock has fChecked set, which
+ * makes the CheckBlock call in ConnectBlock free. Blocks that fail to read or
+ * check are handed out as nullptr or unchecked respectively, and the master
+ * redoes the work itself to report the error.
+ */
+class CBlockReadAhead
+{
+private:
+    struct Job {
+        const uint256 hash;
+        const FlatFilePos pos;
+        const Consensus::Params& params;
+        std::shared_ptr<const CBlock> block;
+        bool fStarted = false;
+        bool fDone = false;
+
+        Job(const uint256& hashIn, const FlatFilePos& posIn, const Consensus::Params& paramsIn) : hash(hashIn), pos(posIn), params(paramsIn) {}
+    };
+
+    //! Mutex to protect the inner state
+    boost::mutex mutex;
+
+    //! Worker threads block on this when out of work
+    boost::condition_variable condWorker;
+
+    //! Master thread blocks on this while a block it needs is being read
+    boost::condition_variable condMaster;
+
+    //! The blocks to read, in the order they will be connected.
+    std::vector<std::shared_ptr<Job>> window;
+
+    //! Read and check the block of job, without holding the lock.
+    static void Process(Job& job);
+
+    //! Return the first job in the window that no thread has started yet.
+    std::shared_ptr<Job> NextJob();
+
+public:
+    //! Worker thread
+    void Thread();
+
+    /**
+     * Replace the window of blocks to read, given as (hash, position) pairs.
+     * Blocks that were already in the window are kept; all others are
+     * forgotten, even when a worker is still reading them.
+     */
+    void SetWindow(const std::vector<std::pair<uint256, FlatFilePos>>& blocks, const Consensus::Params& params);
+
+    /**
+     * Return the block with the given hash from the window, waiting for it to
+     * be read if necessary. A block that is not in the window or that nobody
+     * has started to read yet is read by the calling thread. Returns nullptr
+     * if the block could not be read.
+     */
+    std::shared_ptr<const CBlock> Get(const uint256& hash, const FlatFilePos& pos, const Consensus::Params& params);
+};
+
+#endif // BITCOIN_BLOCKREADAHEAD_H
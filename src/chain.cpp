@@ -169,3 +169,18 @@ const CBlockIndex* LastCommonAncestor(const CBlockIndex* pa, const CBlockIndex*
     assert(pa == pb);
     return pa;
 }
+
+CBlockIndex* CBlockIndexArena::New()
+{
+    if (m_chunk_used == CHUNK_SIZE) {
+        m_chunks.emplace_back(new CBlockIndex[CHUNK_SIZE]);
+        m_chunk_used = 0;
+    }
+    return &m_chunks.back()[m_chunk_used++];
+}
+
+void CBlockIndexArena::Clear()
+{
+    m_chunks.clear();
+    m_chunk_used = CHUNK_SIZE;
+}
@@ -8,6 +8,8 @@
 #include <sync.h>
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -25,12 +27,29 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker (and the master) owns a deque of verifications, each with
+  * its own lock, over which added verifications are spread. A worker takes
+  * batches from the back of its own deque, and when that runs dry, steals
+  * half of another deque from the front. No lock is shared by all workers
+  * in the common case; the global mutex is only taken to go to sleep when
+  * there is no work at all, and to wake sleepers up.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! Maximum number of deques; workers beyond this only steal
+    static const int MAX_WORKERS = 128;
+
+    //! A deque of verifications owned by one worker
+    struct WorkerQueue {
+        boost::mutex mutex;
+        //! As the order of booleans doesn't matter, the owner uses it as a LIFO (stack)
+        std::deque<T> checks;
+    };
+
+    //! Mutex for sleeping and waking up
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,87 +58,113 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The per-worker deques. Index 0 belongs to the master.
+    std::vector<WorkerQueue> queues;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of deques handed out so far (including the master's).
+    std::atomic<int> nQueues;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The number of elements in the deques, not yet taken by any worker.
+    std::atomic<unsigned int> nQueued;
+
+    //! The number of workers that are asleep.
+    int nIdle;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! Index of the deque the next Add starts distributing at
+    int nAddStart;
+
+    //! The number of deques in use
+    int QueueCount() const
+    {
+        const int nCount = nQueues;
+        return nCount < MAX_WORKERS ? nCount : MAX_WORKERS;
+    }
+
+    /** Move up to nBatchSize elements from the back (own deque) or front (stolen) of q into vChecks. */
+    bool Take(WorkerQueue& q, bool fSteal, std::vector<T>& vChecks)
+    {
+        boost::unique_lock<boost::mutex> lock(q.mutex);
+        if (q.checks.empty()) return false;
+        // Stealing takes half of the victim's work, so that both end up with
+        // some; own work is taken in batches that shrink towards the end.
+        const unsigned int nSize = q.checks.size();
+        unsigned int nNow = fSteal ? (nSize + 1) / 2 : nSize / 2 + 1;
+        nNow = std::max(1U, std::min(nBatchSize, nNow));
+        vChecks.resize(nNow);
+        for (unsigned int i = 0; i < nNow; i++) {
+            // Swap jobs out of the deque instead of copying them.
+            if (fSteal) {
+                vChecks[i].swap(q.checks.front());
+                q.checks.pop_front();
+            } else {
+                vChecks[i].swap(q.checks.back());
+                q.checks.pop_back();
+            }
+        }
+        nQueued -= nNow;
+        return true;
+    }
+
+    /** Find a batch of work, starting with deque nSelf (which may be out of range). */
+    bool FindWork(int nSelf, std::vector<T>& vChecks)
+    {
+        const int nCount = QueueCount();
+        if (nSelf < nCount && Take(queues[nSelf], false, vChecks)) return true;
+        for (int i = 1; i <= nCount; i++) {
+            const int nVictim = (nSelf + i) % nCount;
+            if (nVictim != nSelf && Take(queues[nVictim], true, vChecks)) return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(int nSelf, bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
+            if (FindWork(nSelf, vChecks)) {
+                // execute work
+                bool fOk = fAllOk;
+                for (T& check : vChecks)
+                    if (fOk)
+                        fOk = check();
+                if (!fOk) fAllOk = false;
+                const unsigned int nNow = vChecks.size();
+                // Destroy the checks before reporting them as done.
+                vChecks.clear();
+                if ((nTodo -= nNow) == 0 && !fMaster) {
+                    // We processed the last element; inform the master it can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condMaster.notify_one();
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster) {
+                if (nTodo == 0) {
+                    // return the current status, and reset it for new work later
+                    return fAllOk.exchange(true);
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                if (nQueued == 0) condMaster.wait(lock);
+            } else if (nQueued == 0) {
+                nIdle++;
+                condWorker.wait(lock); // wait
+                nIdle--;
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
         } while (true);
     }
 
@@ -128,32 +173,43 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : queues(MAX_WORKERS), nQueues(1), nQueued(0), nIdle(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn), nAddStart(0) {}
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        Loop(nQueues++);
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(0, true);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty()) return;
         nTodo += vChecks.size();
+        nQueued += vChecks.size();
+        // Spread the checks over the deques in contiguous chunks.
+        const int nCount = QueueCount();
+        const size_t nChunk = (vChecks.size() + nCount - 1) / nCount;
+        for (size_t nPos = 0; nPos < vChecks.size(); nPos += nChunk) {
+            WorkerQueue& q = queues[nAddStart];
+            nAddStart = (nAddStart + 1) % nCount;
+            boost::unique_lock<boost::mutex> lock(q.mutex);
+            for (size_t i = nPos; i < std::min(nPos + nChunk, vChecks.size()); i++) {
+                q.checks.emplace_back();
+                q.checks.back().swap(vChecks[i]);
+            }
+        }
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nIdle == 0) return;
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
@@ -12,11 +12,13 @@
 #include <crypto/siphash.h>
 #include <memusage.h>
 #include <serialize.h>
+#include <support/allocators/pool.h>
 #include <uint256.h>
 
 #include <assert.h>
 #include <stdint.h>
 
+#include <limits>
 #include <unordered_map>
 
 /**
@@ -119,7 +121,17 @@ struct CCoinsCacheEntry
     explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * The nodes of CCoinsMap are allocated from a PoolResource, instead of one by
+ * one with malloc. The size of a node depends on the standard library (it
+ * holds one or two pointers, and possibly the hash, besides the entry), so
+ * the pool serves blocks of up to four pointers more than an entry.
+ */
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher, std::equal_to<COutPoint>,
+                           PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>,
+                                         sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) + sizeof(void*) * 4,
+                                         alignof(void*)>> CCoinsMap;
+typedef CCoinsMap::allocator_type::ResourceType CCoinsMapMemoryResource;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -164,8 +176,9 @@ public:
     virtual std::vector<uint256> GetHeadBlocks() const;
 
     //! Do a bulk modification (multiple Coin changes + BestBlock change).
-    //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    //! The passed mapCoins can be modified. If erase is true, the entries
+    //! of mapCoins are consumed; otherwise they are left untouched.
+    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true);
 
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
@@ -191,7 +204,7 @@ public:
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     void SetBackend(CCoinsView &viewIn);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override;
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
 };
@@ -206,6 +219,8 @@ protected:
      * declared as "const".
      */
     mutable uint256 hashBlock;
+    //! The memory the nodes of cacheCoins are allocated from; must be declared before it.
+    mutable CCoinsMapMemoryResource cacheCoinsMemoryResource;
     mutable CCoinsMap cacheCoins;
 
     /* Cached dynamic memory usage for the inner Coin objects. */
@@ -224,7 +239,7 @@ public:
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     void SetBestBlock(const uint256 &hashBlock);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override;
     CCoinsViewCursor* Cursor() const override {
         throw std::logic_error("CCoinsViewCache cursor iteration not supported.");
     }
@@ -261,6 +276,13 @@ public:
      */
     bool SpendCoin(const COutPoint &outpoint, Coin* moveto = nullptr);
 
+    /**
+     * Insert an unmodified coin that was read from the backing view ahead of
+     * time. Has no effect if an entry for the outpoint is already cached, as
+     * that entry may be more recent. Returns whether the coin was inserted.
+     */
+    bool WarmCoin(const COutPoint &outpoint, Coin&& coin);
+
     /**
      * Push the modifications applied to this cache to its base.
      * Failure to call this method before destruction will cause the changes to be forgotten.
@@ -268,6 +290,17 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push the modifications applied to this cache to its base, like Flush(),
+     * but keep the unspent coins in the cache, as unmodified entries.
+     *
+     * If the memory usage of the cache is still above nMaxUsage afterwards,
+     * unmodified coins are removed until it is not. Coins that were
+     * unmodified before the call are removed before the ones that were just
+     * written, as the latter were created or used more recently.
+     */
+    bool Sync(size_t nMaxUsage = std::numeric_limits<size_t>::max());
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
@@ -299,6 +332,13 @@ private:
      * memory usage.
      */
     CCoinsMap::iterator FetchCoin(const COutPoint &outpoint) const;
+
+    /**
+     * Give the memory of the (empty) cache back, by recreating cacheCoins on a
+     * new memory resource. Clearing the map would only put its nodes on the
+     * free lists of the pool.
+     */
+    void ReallocateCache();
 };
 
 //! Utility function to add all of a transaction's outputs to a cache.
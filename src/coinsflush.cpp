@@ -0,0 +1,170 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coinsflush.h>
+
+#include <logging.h>
+
+#include <iterator>
+#include <stdexcept>
+
+#include <boost/thread/thread.hpp>
+
+CCoinsViewFlusher::Batch::Batch(const uint256& hashBlockIn) :
+    coins(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), CCoinsMap::allocator_type(&resource)),
+    hashBlock(hashBlockIn), nCoinsUsage(0) {}
+
+CCoinsViewFlusher::CCoinsViewFlusher(CCoinsView* viewIn) : CCoinsViewBacked(viewIn), fPending(false), fFailed(false), fWriterRunning(false) {}
+
+bool CCoinsViewFlusher::GetCoin(const COutPoint& outpoint, Coin& coin) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (batch) {
+            CCoinsMap::const_iterator it = batch->coins.find(outpoint);
+            if (it != batch->coins.end()) {
+                if (it->second.coin.IsSpent()) return false;
+                coin = it->second.coin;
+                return true;
+            }
+        }
+    }
+    // The batch is only dropped once it is in the base, so a coin that is
+    // not in it can be looked up in the base without holding the lock.
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewFlusher::HaveCoin(const COutPoint& outpoint) const
+{
+    Coin coin;
+    return GetCoin(outpoint, coin);
+}
+
+uint256 CCoinsViewFlusher::GetBestBlock() const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (batch) return batch->hashBlock;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewFlusher::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    WaitForWriter(lock);
+    if (fFailed) return false;
+    if (!fWriterRunning) {
+        lock.unlock();
+        return base->BatchWrite(mapCoins, hashBlock, erase);
+    }
+    lock.unlock();
+
+    // Only dirty entries are written; nothing else can change the batch
+    // until it is handed off below.
+    std::unique_ptr<Batch> batchNew(new Batch(hashBlock));
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = erase ? mapCoins.erase(it) : std::next(it)) {
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) continue;
+        CCoinsCacheEntry& entry = batchNew->coins[it->first];
+        if (erase) {
+            entry.coin = std::move(it->second.coin);
+        } else {
+            entry.coin = it->second.coin;
+        }
+        entry.flags = CCoinsCacheEntry::DIRTY;
+        batchNew->nCoinsUsage += entry.coin.DynamicMemoryUsage();
+    }
+
+    lock.lock();
+    batch = std::move(batchNew);
+    fPending = true;
+    condWriter.notify_one();
+    return true;
+}
+
+CCoinsViewCursor* CCoinsViewFlusher::Cursor() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    WaitForWriter(lock);
+    return base->Cursor();
+}
+
+bool CCoinsViewFlusher::WritePending(boost::unique_lock<boost::mutex>& lock)
+{
+    // Lookups keep reading the batch while it is written, which is safe as
+    // BatchWrite leaves it unmodified when not erasing. The write itself is
+    // not interrupted, so it is never abandoned halfway.
+    boost::this_thread::disable_interruption no_interruption;
+    Batch& batchWrite = *batch;
+    lock.unlock();
+    bool fOk;
+    try {
+        fOk = base->BatchWrite(batchWrite.coins, batchWrite.hashBlock, false);
+    } catch (const std::runtime_error& e) {
+        LogPrintf("Error writing coins in the background: %s\n", e.what());
+        fOk = false;
+    }
+    lock.lock();
+    if (fOk) {
+        batch.reset();
+    } else {
+        fFailed = true;
+    }
+    fPending = false;
+    condMaster.notify_all();
+    return fOk;
+}
+
+void CCoinsViewFlusher::WaitForWriter(boost::unique_lock<boost::mutex>& lock) const
+{
+    // Callers may run in interruptible threads, but must not return before
+    // the batch is written.
+    boost::this_thread::disable_interruption no_interruption;
+    while (fPending) {
+        condMaster.wait(lock);
+    }
+}
+
+bool CCoinsViewFlusher::Thread()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fWriterRunning = true;
+    try {
+        while (true) {
+            while (!fPending) {
+                condWriter.wait(lock);
+            }
+            if (!WritePending(lock)) {
+                fWriterRunning = false;
+                return false;
+            }
+        }
+    } catch (const boost::thread_interrupted&) {
+        // A batch may have been handed off just before the interruption;
+        // nobody else would write it.
+        fWriterRunning = false;
+        if (fPending) WritePending(lock);
+        throw;
+    }
+}
+
+bool CCoinsViewFlusher::IsAsync() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return fWriterRunning;
+}
+
+bool CCoinsViewFlusher::Wait()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    WaitForWriter(lock);
+    return !fFailed;
+}
+
+size_t CCoinsViewFlusher::DynamicMemoryUsage() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!batch) return 0;
+    return memusage::DynamicUsage(batch->coins) + batch->nCoinsUsage;
+}
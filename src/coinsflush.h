@@ -0,0 +1,98 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSFLUSH_H
+#define BITCOIN_COINSFLUSH_H
+
+#include <coins.h>
+#include <uint256.h>
+
+#include <memory>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/**
+ * CCoinsView layer that writes batches to its base in the background.
+ *
+ * A batch passed to BatchWrite is frozen: its dirty entries are moved into a
+ * map of its own, which a writer thread then writes to the base, while the
+ * caller's cache is free to accept new changes. Until the write has completed,
+ * lookups are answered from the frozen batch first, so the layer as a whole
+ * always reflects the last batch passed to it. The best block of the base
+ * only advances once the batch is committed, as it is written together with
+ * the coins.
+ *
+ * Only one batch is in flight at a time; BatchWrite waits for the previous
+ * batch to be written before freezing the next one. Without a running writer
+ * thread, batches are written synchronously. A failed write is not retried:
+ * the batch is kept so lookups stay correct, and all further writes fail.
+ */
+class CCoinsViewFlusher : public CCoinsViewBacked
+{
+private:
+    //! A frozen batch, with the memory its nodes are allocated from.
+    struct Batch {
+        CCoinsMapMemoryResource resource;
+        CCoinsMap coins;
+        uint256 hashBlock;
+        //! Dynamic memory usage of the coins themselves
+        size_t nCoinsUsage;
+
+        explicit Batch(const uint256& hashBlockIn);
+    };
+
+    //! Mutex to protect the inner state
+    mutable boost::mutex mutex;
+
+    //! The writer thread blocks on this when there is no batch to write
+    boost::condition_variable condWriter;
+
+    //! Callers of BatchWrite and Wait block on this while a batch is in flight
+    mutable boost::condition_variable condMaster;
+
+    //! The frozen batch; kept after a failed write.
+    std::unique_ptr<Batch> batch;
+
+    //! Whether the frozen batch still has to be written.
+    bool fPending;
+
+    //! Whether a write has failed.
+    bool fFailed;
+
+    //! Whether a writer thread is running.
+    bool fWriterRunning;
+
+    //! Write the pending batch to the base, without holding the lock.
+    bool WritePending(boost::unique_lock<boost::mutex>& lock);
+
+    //! Block until no batch is in flight.
+    void WaitForWriter(boost::unique_lock<boost::mutex>& lock) const;
+
+public:
+    explicit CCoinsViewFlusher(CCoinsView* viewIn);
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override;
+    bool HaveCoin(const COutPoint& outpoint) const override;
+    uint256 GetBestBlock() const override;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase = true) override;
+    CCoinsViewCursor* Cursor() const override;
+
+    /**
+     * Writer thread. Returns false if a write failed; when interrupted, a
+     * batch that was already handed off is written before exiting.
+     */
+    bool Thread();
+
+    //! Whether batches are handed off to a writer thread
+    bool IsAsync() const;
+
+    //! Wait until the batch in flight (if any) is written. Returns false if a write failed.
+    bool Wait();
+
+    //! Memory used by the batch in flight
+    size_t DynamicMemoryUsage() const;
+};
+
+#endif // BITCOIN_COINSFLUSH_H
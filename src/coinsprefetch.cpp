@@ -0,0 +1,105 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coinsprefetch.h>
+
+#include <algorithm>
+#include <set>
+
+bool CCoinsPrefetcher::ProcessBatch(boost::unique_lock<boost::mutex>& lock)
+{
+    if (queue.empty()) return false;
+
+    unsigned int nNow = std::min<size_t>(nBatchSize, queue.size());
+    std::vector<COutPoint> vBatch(queue.end() - nNow, queue.end());
+    queue.resize(queue.size() - nNow);
+    CCoinsView* view = base;
+    const uint64_t generation = nGeneration;
+
+    std::vector<std::pair<COutPoint, Coin>> vFound;
+    lock.unlock();
+    for (const COutPoint& outpoint : vBatch) {
+        Coin coin;
+        try {
+            if (!view->GetCoin(outpoint, coin)) continue;
+        } catch (const std::exception&) {
+            // Leave the lookup to the validation code, which knows how to
+            // deal with database errors.
+            continue;
+        }
+        vFound.emplace_back(outpoint, std::move(coin));
+    }
+    lock.lock();
+
+    if (generation == nGeneration) {
+        for (auto& found : vFound) {
+            results.push_back(std::move(found));
+        }
+    }
+    nTodo -= nNow;
+    if (nTodo == 0) condMaster.notify_one();
+    return true;
+}
+
+void CCoinsPrefetcher::Thread()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (true) {
+        while (queue.empty()) {
+            condWorker.wait(lock);
+        }
+        ProcessBatch(lock);
+    }
+}
+
+void CCoinsPrefetcher::Prefetch(CCoinsView* baseIn, const CCoinsViewCache& cache, const CBlock& block)
+{
+    std::vector<COutPoint> vOutPoints;
+    std::set<uint256> setTxids;
+    for (const auto& tx : block.vtx) {
+        if (!tx->IsCoinBase()) {
+            for (const CTxIn& txin : tx->vin) {
+                if (setTxids.count(txin.prevout.hash) || cache.HaveCoinInCache(txin.prevout)) continue;
+                vOutPoints.push_back(txin.prevout);
+            }
+        }
+        setTxids.insert(tx->GetHash());
+    }
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (vOutPoints.empty()) return;
+    base = baseIn;
+    queue.insert(queue.end(), vOutPoints.begin(), vOutPoints.end());
+    nTodo += vOutPoints.size();
+    condWorker.notify_all();
+}
+
+size_t CCoinsPrefetcher::Apply(CCoinsViewCache& cache)
+{
+    std::vector<std::pair<COutPoint, Coin>> vFetched;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (ProcessBatch(lock)) {}
+        while (nTodo > 0) {
+            condMaster.wait(lock);
+        }
+        vFetched.swap(results);
+    }
+
+    size_t nInserted = 0;
+    for (auto& fetched : vFetched) {
+        if (cache.WarmCoin(fetched.first, std::move(fetched.second))) ++nInserted;
+    }
+    return nInserted;
+}
+
+void CCoinsPrefetcher::Discard()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nTodo -= queue.size();
+    queue.clear();
+    results.clear();
+    nGeneration++;
+    if (nTodo == 0) condMaster.notify_one();
+}
@@ -0,0 +1,92 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSPREFETCH_H
+#define BITCOIN_COINSPREFETCH_H
+
+#include <coins.h>
+#include <primitives/block.h>
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/**
+ * Queue of UTXO lookups that are performed ahead of block connection.
+ *
+ * One thread (the master, holding cs_main) queues the prevouts of a block
+ * that is about to be connected, after which N worker threads look them up
+ * in the backing database. This lets the disk reads overlap with the
+ * validation of the previous block. Before connecting the block, the master
+ * joins the worker pool until all lookups are done, and moves the fetched
+ * coins into its cache.
+ *
+ * Fetched coins are only ever inserted for outpoints that have no entry in
+ * the cache, since any cached entry is at least as recent as the database.
+ * Because the database itself only changes when the cache is flushed,
+ * Discard() must be called after every flush: lookups that were started
+ * before it may have observed a stale database and are dropped.
+ */
+class CCoinsPrefetcher
+{
+private:
+    //! Mutex to protect the inner state
+    boost::mutex mutex;
+
+    //! Worker threads block on this when out of work
+    boost::condition_variable condWorker;
+
+    //! Master thread blocks on this while lookups are in flight
+    boost::condition_variable condMaster;
+
+    //! The view lookups are performed against. Must be safe for concurrent reads.
+    CCoinsView* base;
+
+    //! Outpoints that still have to be looked up.
+    std::vector<COutPoint> queue;
+
+    //! Coins that were found, waiting to be moved into the cache.
+    std::vector<std::pair<COutPoint, Coin>> results;
+
+    //! Number of lookups queued or in flight.
+    unsigned int nTodo;
+
+    //! Incremented by Discard(); lookups started in an earlier generation are dropped.
+    uint64_t nGeneration;
+
+    //! The maximum number of lookups to perform in one batch.
+    const unsigned int nBatchSize;
+
+    /**
+     * Take a batch from the queue, look it up without holding the lock, and
+     * publish the results. Returns false if the queue was empty.
+     */
+    bool ProcessBatch(boost::unique_lock<boost::mutex>& lock);
+
+public:
+    explicit CCoinsPrefetcher(unsigned int nBatchSizeIn) : base(nullptr), nTodo(0), nGeneration(0), nBatchSize(nBatchSizeIn) {}
+
+    //! Worker thread
+    void Thread();
+
+    /**
+     * Queue lookups in base for all outpoints spent by block that are neither
+     * in cache nor created earlier in the same block.
+     */
+    void Prefetch(CCoinsView* baseIn, const CCoinsViewCache& cache, const CBlock& block);
+
+    /**
+     * Finish all queued lookups (helping the workers), and insert the fetched
+     * coins into cache. Returns the number of coins inserted.
+     */
+    size_t Apply(CCoinsViewCache& cache);
+
+    //! Drop all queued lookups and any results of lookups already in flight.
+    void Discard();
+};
+
+#endif // BITCOIN_COINSPREFETCH_H
@@ -95,6 +95,12 @@ typedef char* sockopt_arg_type;
 #define USE_POLL
 #endif
 
+// epoll is preferred over poll where available; poll remains the fallback if
+// an epoll instance cannot be created.
+#if defined(__linux__) && defined(HAVE_SYS_EPOLL_H)
+#define USE_EPOLL
+#endif
+
 bool static inline IsSelectableSocket(const SOCKET& s) {
 #if defined(USE_POLL) || defined(WIN32)
     return true;
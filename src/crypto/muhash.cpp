@@ -0,0 +1,270 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/muhash.h>
+
+#include <crypto/chacha20.h>
+#include <crypto/common.h>
+#include <crypto/sha256.h>
+
+#include <assert.h>
+#include <limits>
+
+#include <string.h>
+
+namespace {
+
+using limb_t = Num3072::limb_t;
+using double_limb_t = Num3072::double_limb_t;
+constexpr int LIMB_SIZE = Num3072::LIMB_SIZE;
+constexpr int LIMBS = Num3072::LIMBS;
+/** 2^3072 - 1103717 is the largest 3072-bit safe prime number. */
+constexpr limb_t MAX_PRIME_DIFF = 1103717;
+
+/** Set [c,n] = [c,n] + a * b, where the sum does not overflow. */
+inline void MulAdd(limb_t& c, limb_t& n, limb_t a, limb_t b)
+{
+    double_limb_t t = (double_limb_t)a * b + c;
+    c = t >> LIMB_SIZE;
+    n += (limb_t)t;
+    c += n < (limb_t)t;
+}
+
+/** Add a to the number in limbs, starting at limb i. Returns the carry out of the top limb. */
+inline limb_t AddFrom(limb_t* limbs, int i, limb_t a)
+{
+    for (; i < LIMBS && a; ++i) {
+        limbs[i] += a;
+        a = limbs[i] < a;
+    }
+    return a;
+}
+
+/** Reduce a 6144-bit product into out, which is then below 2^3072. */
+void Reduce(Num3072& out, const limb_t (&product)[2 * LIMBS])
+{
+    // As 2^3072 = MAX_PRIME_DIFF modulo the prime, the high half of the
+    // product can be folded into the low half: low + high * MAX_PRIME_DIFF.
+    limb_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        limb_t n = product[i];
+        MulAdd(carry, n, product[i + LIMBS], MAX_PRIME_DIFF);
+        out.limbs[i] = n;
+    }
+    // Fold the remaining carry in the same way. This can only overflow once
+    // more, leaving a small number that the last fold cannot overflow.
+    double_limb_t extra = (double_limb_t)carry * MAX_PRIME_DIFF;
+    while (extra) {
+        limb_t overflow = AddFrom(out.limbs, 0, (limb_t)extra);
+        overflow += AddFrom(out.limbs, 1, (limb_t)(extra >> LIMB_SIZE));
+        extra = (double_limb_t)overflow * MAX_PRIME_DIFF;
+    }
+}
+
+} // namespace
+
+bool Num3072::IsOverflow() const
+{
+    if (this->limbs[0] <= std::numeric_limits<limb_t>::max() - MAX_PRIME_DIFF) return false;
+    for (int i = 1; i < LIMBS; ++i) {
+        if (this->limbs[i] != std::numeric_limits<limb_t>::max()) return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // Subtracting the prime is adding MAX_PRIME_DIFF and dropping the 2^3072 bit.
+    AddFrom(this->limbs, 0, MAX_PRIME_DIFF);
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    // Schoolbook multiplication into a 6144-bit product.
+    limb_t product[2 * LIMBS] = {};
+    for (int i = 0; i < LIMBS; ++i) {
+        limb_t carry = 0;
+        for (int j = 0; j < LIMBS; ++j) {
+            limb_t& n = product[i + j];
+            double_limb_t t = (double_limb_t)this->limbs[i] * a.limbs[j] + n + carry;
+            n = (limb_t)t;
+            carry = t >> LIMB_SIZE;
+        }
+        product[i + LIMBS] = carry;
+    }
+    Reduce(*this, product);
+    if (this->IsOverflow()) this->FullReduce();
+}
+
+void Num3072::Square()
+{
+    // Each product of two different limbs appears twice in the square, so
+    // compute those once and double them, then add the squares of the limbs.
+    limb_t product[2 * LIMBS] = {};
+    for (int i = 0; i < LIMBS; ++i) {
+        limb_t carry = 0;
+        for (int j = i + 1; j < LIMBS; ++j) {
+            limb_t& n = product[i + j];
+            double_limb_t t = (double_limb_t)this->limbs[i] * this->limbs[j] + n + carry;
+            n = (limb_t)t;
+            carry = t >> LIMB_SIZE;
+        }
+        product[i + LIMBS] = carry;
+    }
+    limb_t top = 0;
+    for (int i = 0; i < 2 * LIMBS; ++i) {
+        limb_t n = product[i];
+        product[i] = (n << 1) | top;
+        top = n >> (LIMB_SIZE - 1);
+    }
+    limb_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        double_limb_t t = (double_limb_t)this->limbs[i] * this->limbs[i] + product[2 * i] + carry;
+        product[2 * i] = (limb_t)t;
+        t = (t >> LIMB_SIZE) + product[2 * i + 1];
+        product[2 * i + 1] = (limb_t)t;
+        carry = t >> LIMB_SIZE;
+    }
+    Reduce(*this, product);
+    if (this->IsOverflow()) this->FullReduce();
+}
+
+void Num3072::SetToOne()
+{
+    this->limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i) {
+        this->limbs[i] = 0;
+    }
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // By Fermat's little theorem, the inverse is this^(p - 2), where
+    // p - 2 = (2^3051 - 1) * 2^21 + 993433. The first factor consists of ones
+    // only, so this^(2^3051 - 1) takes few multiplications besides the
+    // squarings: this^(2^2k - 1) = (this^(2^k - 1))^(2^k) * this^(2^k - 1).
+    static constexpr int ONES = 3051;
+    static constexpr int LOW_BITS = 21;
+    static constexpr uint32_t LOW = 993433;
+
+    Num3072 ones = *this; // this^(2^k - 1)
+    int k = 1;
+    int bit = 0;
+    while ((ONES >> (bit + 1)) != 0) ++bit;
+    while (bit-- > 0) {
+        Num3072 shifted = ones;
+        for (int i = 0; i < k; ++i) {
+            shifted.Square();
+        }
+        shifted.Multiply(ones);
+        ones = shifted;
+        k *= 2;
+        if ((ONES >> bit) & 1) {
+            ones.Square();
+            ones.Multiply(*this);
+            ++k;
+        }
+    }
+    assert(k == ONES);
+
+    Num3072 out = ones;
+    for (int i = LOW_BITS - 1; i >= 0; --i) {
+        out.Square();
+        if ((LOW >> i) & 1) out.Multiply(*this);
+    }
+    return out;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    if (this->IsOverflow()) this->FullReduce();
+
+    Num3072 inv{};
+    if (a.IsOverflow()) {
+        Num3072 b = a;
+        b.FullReduce();
+        inv = b.GetInverse();
+    } else {
+        inv = a.GetInverse();
+    }
+
+    this->Multiply(inv);
+    if (this->IsOverflow()) this->FullReduce();
+}
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        if (sizeof(limb_t) == 4) {
+            this->limbs[i] = ReadLE32(data + 4 * i);
+        } else if (sizeof(limb_t) == 8) {
+            this->limbs[i] = ReadLE64(data + 8 * i);
+        }
+    }
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        if (sizeof(limb_t) == 4) {
+            WriteLE32(out + i * 4, this->limbs[i]);
+        } else if (sizeof(limb_t) == 8) {
+            WriteLE64(out + i * 8, this->limbs[i]);
+        }
+    }
+}
+
+Num3072 MuHash3072::ToNum3072(Span<const unsigned char> in)
+{
+    unsigned char tmp[Num3072::BYTE_SIZE];
+
+    unsigned char hashed_in[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(in.data(), in.size()).Finalize(hashed_in);
+    ChaCha20(hashed_in, sizeof(hashed_in)).Keystream(tmp, Num3072::BYTE_SIZE);
+    Num3072 out{tmp};
+
+    return out;
+}
+
+MuHash3072::MuHash3072(Span<const unsigned char> in) noexcept
+{
+    m_numerator = ToNum3072(in);
+}
+
+void MuHash3072::Finalize(uint256& out) noexcept
+{
+    m_numerator.Divide(m_denominator);
+    m_denominator.SetToOne(); // Needed to keep the MuHash object valid
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    m_numerator.ToBytes(data);
+
+    CSHA256().Write(data, Num3072::BYTE_SIZE).Finalize(out.begin());
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul) noexcept
+{
+    m_numerator.Multiply(mul.m_numerator);
+    m_denominator.Multiply(mul.m_denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div) noexcept
+{
+    m_numerator.Multiply(div.m_denominator);
+    m_denominator.Multiply(div.m_numerator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::Insert(Span<const unsigned char> in) noexcept
+{
+    m_numerator.Multiply(ToNum3072(in));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(Span<const unsigned char> in) noexcept
+{
+    m_denominator.Multiply(ToNum3072(in));
+    return *this;
+}
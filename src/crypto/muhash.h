@@ -0,0 +1,122 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
+#include <serialize.h>
+#include <span.h>
+#include <uint256.h>
+
+#include <stdint.h>
+
+/** A number modulo the prime 2^3072 - 1103717, the largest 3072-bit safe prime. */
+class Num3072
+{
+private:
+    void FullReduce();
+    bool IsOverflow() const;
+    Num3072 GetInverse() const;
+
+public:
+    static constexpr size_t BYTE_SIZE = 384;
+
+#ifdef __SIZEOF_INT128__
+    typedef unsigned __int128 double_limb_t;
+    typedef uint64_t limb_t;
+    static constexpr int LIMBS = 48;
+    static constexpr int LIMB_SIZE = 64;
+#else
+    typedef uint64_t double_limb_t;
+    typedef uint32_t limb_t;
+    static constexpr int LIMBS = 96;
+    static constexpr int LIMB_SIZE = 32;
+#endif
+    //! The number, little endian; not necessarily fully reduced modulo the prime.
+    limb_t limbs[LIMBS];
+
+    // Sanity check for the Num3072 constants
+    static_assert(LIMB_SIZE * LIMBS == 3072, "Num3072 isn't 3072 bits");
+    static_assert(sizeof(double_limb_t) == sizeof(limb_t) * 2, "bad size for double_limb_t");
+    static_assert(sizeof(limb_t) * 8 == LIMB_SIZE, "LIMB_SIZE is incorrect");
+
+    void Multiply(const Num3072& a);
+    void Square();
+    void Divide(const Num3072& a);
+    void SetToOne();
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]);
+
+    Num3072() { SetToOne(); }
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        for (int i = 0; i < LIMBS; ++i) {
+            READWRITE(limbs[i]);
+        }
+    }
+};
+
+/**
+ * A hash of a multiset of byte strings (MuHash3072).
+ *
+ * Each element is hashed to a number modulo a 3072-bit prime, and the set
+ * hash is the product of these numbers. As multiplication is commutative,
+ * the hash does not depend on the order elements are inserted in, and an
+ * element can be removed again by dividing by its number. This makes it
+ * possible to maintain the hash of a set that changes over time, such as the
+ * UTXO set, and to combine the hashes of disjoint parts of a set into the
+ * hash of the whole.
+ *
+ * To avoid a modular inversion for every removal, the numerator and the
+ * denominator are kept apart until Finalize.
+ */
+class MuHash3072
+{
+private:
+    Num3072 m_numerator;
+    Num3072 m_denominator;
+
+    Num3072 ToNum3072(Span<const unsigned char> in);
+
+public:
+    //! The hash of the empty set.
+    MuHash3072() noexcept {};
+
+    //! The hash of the set with the single element in.
+    explicit MuHash3072(Span<const unsigned char> in) noexcept;
+
+    //! Insert a single element into the set.
+    MuHash3072& Insert(Span<const unsigned char> in) noexcept;
+
+    //! Remove a single element from the set.
+    MuHash3072& Remove(Span<const unsigned char> in) noexcept;
+
+    //! Multiply (resulting in a hash for the union of two sets).
+    MuHash3072& operator*=(const MuHash3072& mul) noexcept;
+
+    //! Divide (resulting in a hash for the difference of two sets).
+    MuHash3072& operator/=(const MuHash3072& div) noexcept;
+
+    //! Finalize into a 32-byte hash. Does not change this object's value.
+    void Finalize(uint256& out) noexcept;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(m_numerator);
+        READWRITE(m_denominator);
+    }
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
@@ -6,6 +6,7 @@
 
 #include <memory>
 #include <random.h>
+#include <sync.h>
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
@@ -13,6 +14,49 @@
 #include <memenv.h>
 #include <stdint.h>
 #include <algorithm>
+#include <set>
+
+//! Names of the databases that can be tuned with -dbparam
+static const std::vector<std::string> DB_PARAM_NAMES{"blockfilterindex", "blockindex", "chainstate", "coinstatsindex", "txindex"};
+
+static Mutex g_dbs_mutex;
+//! All open databases, for ListDBs
+static std::set<const CDBWrapper*> g_dbs GUARDED_BY(g_dbs_mutex);
+
+/** Block cache that counts its hits and misses. */
+class CCountingLevelDBCache : public leveldb::Cache {
+private:
+    const std::unique_ptr<leveldb::Cache> m_cache;
+    const size_t m_capacity;
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+
+public:
+    explicit CCountingLevelDBCache(size_t capacity) : m_cache(leveldb::NewLRUCache(capacity)), m_capacity(capacity) {}
+
+    Handle* Insert(const leveldb::Slice& key, void* value, size_t charge, void (*deleter)(const leveldb::Slice& key, void* value)) override
+    {
+        return m_cache->Insert(key, value, charge, deleter);
+    }
+
+    Handle* Lookup(const leveldb::Slice& key) override
+    {
+        Handle* handle = m_cache->Lookup(key);
+        (handle ? m_hits : m_misses).fetch_add(1, std::memory_order_relaxed);
+        return handle;
+    }
+
+    void Release(Handle* handle) override { m_cache->Release(handle); }
+    void* Value(Handle* handle) override { return m_cache->Value(handle); }
+    void Erase(const leveldb::Slice& key) override { m_cache->Erase(key); }
+    uint64_t NewId() override { return m_cache->NewId(); }
+    void Prune() override { m_cache->Prune(); }
+    size_t TotalCharge() const override { return m_cache->TotalCharge(); }
+
+    size_t Capacity() const { return m_capacity; }
+    uint64_t Hits() const { return m_hits.load(std::memory_order_relaxed); }
+    uint64_t Misses() const { return m_misses.load(std::memory_order_relaxed); }
+};
 
 class CBitcoinLevelDBLogger : public leveldb::Logger {
 public:
@@ -97,13 +141,113 @@ static void SetMaxOpenFiles(leveldb::Options *options) {
              options->max_open_files, default_open_files);
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+/** Parse a single -dbparam setting, of the form <param>=<value>, into params. */
+static bool ParseDBParam(const std::string& setting, DBParams& params, std::string& error)
+{
+    const size_t pos = setting.find('=');
+    const std::string param = setting.substr(0, pos);
+    int64_t value;
+    if (pos == std::string::npos || !ParseInt64(setting.substr(pos + 1), &value)) {
+        error = strprintf("Invalid value in -dbparam setting '%s'", setting);
+        return false;
+    }
+    // The ranges are the ones LevelDB would otherwise clip the values to.
+    if (param == "blocksize" && value >= 1 << 10 && value <= 4 << 20) {
+        params.block_size = value;
+    } else if (param == "bloombits" && value >= 0 && value <= 64) {
+        params.bloom_bits = value;
+    } else if (param == "compression" && (value == 0 || value == 1)) {
+        params.compression = value == 1;
+    } else if (param == "writebuffersize" && (value == 0 || (value >= 64 << 10 && value <= 1 << 30))) {
+        params.write_buffer_size = value;
+    } else if (param == "maxfilesize" && value >= 1 << 20 && value <= 1 << 30) {
+        params.max_file_size = value;
+    } else {
+        error = strprintf("Unknown parameter or value out of range in -dbparam setting '%s'", setting);
+        return false;
+    }
+    return true;
+}
+
+bool ParseDBParams(const std::string& db_name, DBParams& params, std::string& error)
+{
+    const std::string prefix = db_name + ".";
+    for (const std::string& arg : gArgs.GetArgs("-dbparam")) {
+        if (arg.compare(0, prefix.size(), prefix) == 0 && !ParseDBParam(arg.substr(prefix.size()), params, error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CheckDBParams(std::string& error)
+{
+    for (const std::string& arg : gArgs.GetArgs("-dbparam")) {
+        const std::string db_name = arg.substr(0, arg.find('.'));
+        if (std::find(DB_PARAM_NAMES.begin(), DB_PARAM_NAMES.end(), db_name) == DB_PARAM_NAMES.end()) {
+            error = strprintf("Unknown database in -dbparam setting '%s'", arg);
+            return false;
+        }
+    }
+    DBParams params;
+    for (const std::string& db_name : DB_PARAM_NAMES) {
+        if (!ParseDBParams(db_name, params, error)) return false;
+    }
+    return true;
+}
+
+std::vector<DBInfo> ListDBs()
+{
+    LOCK(g_dbs_mutex);
+    std::vector<DBInfo> dbs;
+    for (const CDBWrapper* db : g_dbs) {
+        dbs.push_back(db->GetInfo());
+    }
+    std::sort(dbs.begin(), dbs.end(), [](const DBInfo& a, const DBInfo& b) { return a.path < b.path; });
+    return dbs;
+}
+
+std::vector<DBStats> GetDBStats(bool include_sstables)
+{
+    // The lock keeps the databases from being closed while they are queried.
+    LOCK(g_dbs_mutex);
+    std::vector<DBStats> dbs;
+    for (const CDBWrapper* db : g_dbs) {
+        dbs.push_back(db->GetStats(include_sstables));
+    }
+    std::sort(dbs.begin(), dbs.end(), [](const DBStats& a, const DBStats& b) { return a.path < b.path; });
+    return dbs;
+}
+
+void DBLatencyHistogram::Add(std::chrono::steady_clock::duration duration)
+{
+    uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    int bucket = 0;
+    while (bucket < BUCKETS - 1 && micros >= (uint64_t{1} << bucket)) {
+        ++bucket;
+    }
+    m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+std::vector<uint64_t> DBLatencyHistogram::Get() const
+{
+    std::vector<uint64_t> buckets;
+    for (const auto& bucket : m_buckets) {
+        buckets.push_back(bucket.load(std::memory_order_relaxed));
+    }
+    return buckets;
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, const DBParams& params)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
+    options.block_cache = new CCountingLevelDBCache(nCacheSize / 2);
+    // up to two write buffers may be held in memory simultaneously
+    options.write_buffer_size = params.write_buffer_size ? params.write_buffer_size : nCacheSize / 4;
+    options.filter_policy = params.bloom_bits ? leveldb::NewBloomFilterPolicy(params.bloom_bits) : nullptr;
+    options.compression = params.compression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.block_size = params.block_size;
+    options.max_file_size = params.max_file_size;
     options.info_log = new CBitcoinLevelDBLogger();
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
@@ -114,15 +258,19 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
-    : m_name{path.stem().string()}
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, const std::string& name)
+    : m_name{name.empty() ? path.stem().string() : name}, m_path{path}, m_cache_size{nCacheSize}
 {
     penv = nullptr;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    std::string error;
+    if (!ParseDBParams(m_name, m_params, error)) {
+        throw dbwrapper_error(error);
+    }
+    options = GetOptions(nCacheSize, m_params);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -164,10 +312,17 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     }
 
     LogPrintf("Using obfuscation key for %s: %s\n", path.string(), HexStr(obfuscate_key));
+
+    LOCK(g_dbs_mutex);
+    g_dbs.insert(this);
 }
 
 CDBWrapper::~CDBWrapper()
 {
+    {
+        LOCK(g_dbs_mutex);
+        g_dbs.erase(this);
+    }
     delete pdb;
     pdb = nullptr;
     delete options.filter_policy;
@@ -187,8 +342,13 @@ bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
     if (log_memory) {
         mem_before = DynamicMemoryUsage() / 1024.0 / 1024;
     }
+    const auto start = std::chrono::steady_clock::now();
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
+    m_batch_latency.Add(std::chrono::steady_clock::now() - start);
     dbwrapper_private::HandleError(status);
+    m_batches.fetch_add(1, std::memory_order_relaxed);
+    if (fSync) m_batches_synced.fetch_add(1, std::memory_order_relaxed);
+    m_batch_bytes.fetch_add(batch.SizeEstimate(), std::memory_order_relaxed);
     if (log_memory) {
         double mem_after = DynamicMemoryUsage() / 1024.0 / 1024;
         LogPrint(BCLog::LEVELDB, "WriteBatch memory usage: db=%s, before=%.1fMiB, after=%.1fMiB\n",
@@ -197,6 +357,65 @@ bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
     return true;
 }
 
+CDBSnapshot CDBWrapper::GetSnapshot() const
+{
+    leveldb::DB* db = pdb;
+    return CDBSnapshot(db->GetSnapshot(), [db](const leveldb::Snapshot* snapshot) { db->ReleaseSnapshot(snapshot); });
+}
+
+DBInfo CDBWrapper::GetInfo() const
+{
+    DBInfo info;
+    info.name = m_name;
+    info.path = m_path;
+    info.in_memory = penv != nullptr;
+    info.cache_size = m_cache_size;
+    info.params = m_params;
+    info.write_buffer_size = options.write_buffer_size;
+    info.max_open_files = options.max_open_files;
+    return info;
+}
+
+DBStats CDBWrapper::GetStats(bool include_sstables) const
+{
+    DBStats stats;
+    stats.name = m_name;
+    stats.path = m_path;
+
+    // Keys are compared bytewise, so this range covers all keys in practice.
+    const std::string key_end(DBWRAPPER_PREALLOC_KEY_SIZE, '\xff');
+    leveldb::Range range("", key_end);
+    pdb->GetApproximateSizes(&range, 1, &stats.approximate_size);
+    stats.memory_usage = DynamicMemoryUsage();
+    std::string value;
+    for (int level = 0; pdb->GetProperty("leveldb.num-files-at-level" + std::to_string(level), &value); ++level) {
+        stats.files_per_level.push_back(atoi(value));
+    }
+    pdb->GetProperty("leveldb.stats", &stats.compaction_stats);
+    if (include_sstables) {
+        pdb->GetProperty("leveldb.sstables", &stats.sstables);
+    }
+
+    const CCountingLevelDBCache* cache = static_cast<const CCountingLevelDBCache*>(options.block_cache);
+    stats.block_cache_usage = cache->TotalCharge();
+    stats.block_cache_capacity = cache->Capacity();
+    stats.block_cache_hits = cache->Hits();
+    stats.block_cache_misses = cache->Misses();
+
+    stats.reads = m_reads.load(std::memory_order_relaxed);
+    stats.reads_not_found = m_reads_not_found.load(std::memory_order_relaxed);
+    stats.read_bytes = m_read_bytes.load(std::memory_order_relaxed);
+    stats.read_latency = m_read_latency.Get();
+    stats.exists = m_exists.load(std::memory_order_relaxed);
+    stats.exists_not_found = m_exists_not_found.load(std::memory_order_relaxed);
+    stats.exists_latency = m_exists_latency.Get();
+    stats.batches = m_batches.load(std::memory_order_relaxed);
+    stats.batches_synced = m_batches_synced.load(std::memory_order_relaxed);
+    stats.batch_bytes = m_batch_bytes.load(std::memory_order_relaxed);
+    stats.batch_latency = m_batch_latency.Get();
+    return stats;
+}
+
 size_t CDBWrapper::DynamicMemoryUsage() const {
     std::string memory;
     if (!pdb->GetProperty("leveldb.approximate-memory-usage", &memory)) {
@@ -13,6 +13,10 @@
 #include <util/strencodings.h>
 #include <version.h>
 
+#include <atomic>
+#include <chrono>
+#include <memory>
+
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
@@ -27,6 +31,99 @@ public:
 
 class CDBWrapper;
 
+/** LevelDB tuning parameters of a database, which can be set with -dbparam */
+struct DBParams {
+    //! Size of the (uncompressed) data blocks in the table files
+    size_t block_size = 4096;
+    //! Bits per key of the bloom filters in the table files (0 = no filters)
+    int bloom_bits = 10;
+    //! Whether data blocks are compressed (only if LevelDB is built with Snappy)
+    bool compression = false;
+    //! Size of the in-memory write buffer (0 = a quarter of the cache size)
+    size_t write_buffer_size = 0;
+    //! Size after which a new table file is started
+    size_t max_file_size = 2 << 20;
+};
+
+/** Description of an open database */
+struct DBInfo {
+    std::string name;
+    fs::path path;
+    bool in_memory;
+    size_t cache_size;
+    DBParams params;
+    //! The write buffer size that is in effect
+    size_t write_buffer_size;
+    int max_open_files;
+};
+
+/**
+ * Histogram of operation latencies. Bucket i counts the operations that took
+ * less than 2^i microseconds (and at least 2^(i-1)); the last bucket counts
+ * all slower ones.
+ */
+class DBLatencyHistogram
+{
+public:
+    static const int BUCKETS = 24;
+
+    void Add(std::chrono::steady_clock::duration duration);
+    std::vector<uint64_t> Get() const;
+
+private:
+    std::atomic<uint64_t> m_buckets[BUCKETS] = {};
+};
+
+/** Statistics of an open database, as collected by CDBWrapper and LevelDB */
+struct DBStats {
+    std::string name;
+    fs::path path;
+    //! Approximate size of the table files
+    uint64_t approximate_size;
+    //! Approximate memory usage of the write buffers and the block cache
+    uint64_t memory_usage;
+    //! Number of table files at each level
+    std::vector<int> files_per_level;
+    //! The leveldb.stats property: compaction statistics per level
+    std::string compaction_stats;
+    //! The leveldb.sstables property: the key ranges of all table files (only if requested)
+    std::string sstables;
+
+    uint64_t block_cache_usage;
+    uint64_t block_cache_capacity;
+    uint64_t block_cache_hits;
+    uint64_t block_cache_misses;
+
+    uint64_t reads;
+    uint64_t reads_not_found;
+    uint64_t read_bytes;
+    std::vector<uint64_t> read_latency;
+
+    uint64_t exists;
+    uint64_t exists_not_found;
+    std::vector<uint64_t> exists_latency;
+
+    uint64_t batches;
+    uint64_t batches_synced;
+    uint64_t batch_bytes;
+    std::vector<uint64_t> batch_latency;
+};
+
+/**
+ * Apply the -dbparam settings for the database db_name to params. Returns
+ * false and sets error if a setting for it is invalid.
+ */
+bool ParseDBParams(const std::string& db_name, DBParams& params, std::string& error);
+
+/** Check that all -dbparam settings are valid. */
+bool CheckDBParams(std::string& error);
+
+/** Describe all currently open databases. */
+std::vector<DBInfo> ListDBs();
+
+/** Collect the statistics of all currently open databases. */
+std::vector<DBStats> GetDBStats(bool include_sstables = false);
+
 /** These should be considered an implementation detail of the specific database.
  */
 namespace dbwrapper_private {
@@ -114,10 +211,15 @@ public:
     size_t SizeEstimate() const { return size_estimate; }
 };
 
+/** A state of a database that iterators can read; released with the last reference to it. */
+typedef std::shared_ptr<const leveldb::Snapshot> CDBSnapshot;
+
 class CDBIterator
 {
 private:
     const CDBWrapper &parent;
+    //! the snapshot the iterator reads, if any, which must outlive it
+    const CDBSnapshot snapshot;
     leveldb::Iterator *piter;
 
 public:
@@ -125,9 +227,10 @@ public:
     /**
      * @param[in] _parent          Parent CDBWrapper instance.
      * @param[in] _piter           The original leveldb iterator.
+     * @param[in] _snapshot        The snapshot the iterator reads, if any.
      */
-    CDBIterator(const CDBWrapper &_parent, leveldb::Iterator *_piter) :
-        parent(_parent), piter(_piter) { };
+    CDBIterator(const CDBWrapper &_parent, leveldb::Iterator *_piter, CDBSnapshot _snapshot = nullptr) :
+        parent(_parent), snapshot(std::move(_snapshot)), piter(_piter) { };
     ~CDBIterator();
 
     bool Valid() const;
@@ -201,6 +304,28 @@ private:
     //! the name of this database
     std::string m_name;
 
+    //! where the database is stored
+    fs::path m_path;
+
+    //! the cache size the database was opened with
+    size_t m_cache_size;
+
+    //! the tuning parameters the database was opened with
+    DBParams m_params;
+
+    //! counters of the operations on the database
+    mutable std::atomic<uint64_t> m_reads{0};
+    mutable std::atomic<uint64_t> m_reads_not_found{0};
+    mutable std::atomic<uint64_t> m_read_bytes{0};
+    mutable DBLatencyHistogram m_read_latency;
+    mutable std::atomic<uint64_t> m_exists{0};
+    mutable std::atomic<uint64_t> m_exists_not_found{0};
+    mutable DBLatencyHistogram m_exists_latency;
+    std::atomic<uint64_t> m_batches{0};
+    std::atomic<uint64_t> m_batches_synced{0};
+    std::atomic<uint64_t> m_batch_bytes{0};
+    DBLatencyHistogram m_batch_latency;
+
     //! a key used for optional XOR-obfuscation of the database
     std::vector<unsigned char> obfuscate_key;
 
@@ -220,8 +345,10 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] name        Name of the database, under which it can be tuned with -dbparam.
+     *                        Defaults to the name of the directory.
      */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, const std::string& name = "");
     ~CDBWrapper();
 
     CDBWrapper(const CDBWrapper&) = delete;
@@ -236,13 +363,19 @@ public:
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
         std::string strValue;
+        const auto start = std::chrono::steady_clock::now();
         leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        m_read_latency.Add(std::chrono::steady_clock::now() - start);
+        m_reads.fetch_add(1, std::memory_order_relaxed);
         if (!status.ok()) {
-            if (status.IsNotFound())
+            if (status.IsNotFound()) {
+                m_reads_not_found.fetch_add(1, std::memory_order_relaxed);
                 return false;
+            }
             LogPrintf("LevelDB read failure: %s\n", status.ToString());
             dbwrapper_private::HandleError(status);
         }
+        m_read_bytes.fetch_add(strValue.size(), std::memory_order_relaxed);
         try {
             CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
             ssValue.Xor(obfuscate_key);
@@ -270,10 +403,15 @@ public:
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
         std::string strValue;
+        const auto start = std::chrono::steady_clock::now();
         leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        m_exists_latency.Add(std::chrono::steady_clock::now() - start);
+        m_exists.fetch_add(1, std::memory_order_relaxed);
         if (!status.ok()) {
-            if (status.IsNotFound())
+            if (status.IsNotFound()) {
+                m_exists_not_found.fetch_add(1, std::memory_order_relaxed);
                 return false;
+            }
             LogPrintf("LevelDB read failure: %s\n", status.ToString());
             dbwrapper_private::HandleError(status);
         }
@@ -293,6 +431,12 @@ public:
     // Get an estimate of LevelDB memory usage (in bytes).
     size_t DynamicMemoryUsage() const;
 
+    //! Describe this database.
+    DBInfo GetInfo() const;
+
+    //! Collect the statistics of this database.
+    DBStats GetStats(bool include_sstables = false) const;
+
     // not available for LevelDB; provide for compatibility with BDB
     bool Flush()
     {
@@ -310,6 +454,17 @@ public:
         return new CDBIterator(*this, pdb->NewIterator(iteroptions));
     }
 
+    //! Take a snapshot of the current state. It must not outlive the database.
+    CDBSnapshot GetSnapshot() const;
+
+    //! Iterate over the state of the database in the snapshot.
+    CDBIterator *NewIterator(const CDBSnapshot& snapshot)
+    {
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot.get();
+        return new CDBIterator(*this, pdb->NewIterator(options), snapshot);
+    }
+
     /**
      * Return true if the database managed by this class contains no entries.
      */
@@ -10,6 +10,13 @@
 #include <tinyformat.h>
 #include <util/system.h>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 FlatFileSeq::FlatFileSeq(fs::path dir, const char* prefix, size_t chunk_size) :
     m_dir(std::move(dir)),
     m_prefix(prefix),
@@ -52,6 +59,43 @@ FILE* FlatFileSeq::Open(const FlatFilePos& pos, bool read_only)
     return file;
 }
 
+FlatFileMapping::~FlatFileMapping()
+{
+#ifndef WIN32
+    munmap(m_data, m_size);
+#endif
+}
+
+std::shared_ptr<const FlatFileMapping> FlatFileSeq::Map(const FlatFilePos& pos) const
+{
+#ifndef WIN32
+    if (pos.IsNull()) {
+        return nullptr;
+    }
+    fs::path path = FileName(pos);
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1) {
+        LogPrintf("Unable to open file %s\n", path.string());
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid after closing the descriptor.
+    close(fd);
+    if (data == MAP_FAILED) {
+        LogPrintf("Unable to map file %s\n", path.string());
+        return nullptr;
+    }
+    return std::make_shared<const FlatFileMapping>(data, st.st_size);
+#else
+    return nullptr;
+#endif
+}
+
 size_t FlatFileSeq::Allocate(const FlatFilePos& pos, size_t add_size, bool& out_of_space)
 {
     out_of_space = false;
@@ -96,3 +140,33 @@ bool FlatFileSeq::Flush(const FlatFilePos& pos, bool finalize)
     fclose(file);
     return true;
 }
+
+std::shared_ptr<const FlatFileMapping> FlatFileMapCache::Get(const FlatFileSeq& seq, const FlatFilePos& pos, size_t min_size)
+{
+    LOCK(m_mutex);
+    auto it = m_mappings.find(pos.nFile);
+    if (it != m_mappings.end() && (size_t)it->second->Data().size() >= min_size) {
+        return it->second;
+    }
+    std::shared_ptr<const FlatFileMapping> mapping = seq.Map(pos);
+    if (!mapping) {
+        return nullptr;
+    }
+    m_mappings[pos.nFile] = mapping;
+    if ((size_t)mapping->Data().size() < min_size) {
+        return nullptr;
+    }
+    return mapping;
+}
+
+void FlatFileMapCache::Erase(int file)
+{
+    LOCK(m_mutex);
+    m_mappings.erase(file);
+}
+
+void FlatFileMapCache::Clear()
+{
+    LOCK(m_mutex);
+    m_mappings.clear();
+}
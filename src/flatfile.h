@@ -6,10 +6,14 @@
 #ifndef BITCOIN_FLATFILE_H
 #define BITCOIN_FLATFILE_H
 
+#include <map>
+#include <memory>
 #include <string>
 
 #include <fs.h>
 #include <serialize.h>
+#include <span.h>
+#include <sync.h>
 
 struct FlatFilePos
 {
@@ -45,6 +49,23 @@ struct FlatFilePos
     std::string ToString() const;
 };
 
+/** A read-only memory mapping of a complete file in a FlatFileSeq. */
+class FlatFileMapping
+{
+private:
+    void* const m_data;
+    const size_t m_size;
+
+public:
+    FlatFileMapping(void* data, size_t size) : m_data(data), m_size(size) {}
+    ~FlatFileMapping();
+
+    FlatFileMapping(const FlatFileMapping&) = delete;
+    FlatFileMapping& operator=(const FlatFileMapping&) = delete;
+
+    Span<const unsigned char> Data() const { return Span<const unsigned char>(static_cast<const unsigned char*>(m_data), m_size); }
+};
+
 /**
  * FlatFileSeq represents a sequence of numbered files storing raw data. This class facilitates
  * access to and efficient management of these files.
@@ -72,6 +93,16 @@ public:
     /** Open a handle to the file at the given position. */
     FILE* Open(const FlatFilePos& pos, bool read_only = false);
 
+    /**
+     * Map the whole file at the given position into memory, read-only. The
+     * file must not be truncated while mapped, as accessing the removed part
+     * of the mapping is fatal; appending to it is fine.
+     *
+     * @return The mapping, or nullptr if the file is empty, cannot be mapped
+     *         or memory mapping is not supported on this platform.
+     */
+    std::shared_ptr<const FlatFileMapping> Map(const FlatFilePos& pos) const;
+
     /**
      * Allocate additional space in a file after the given starting position. The amount allocated
      * will be the minimum multiple of the sequence chunk size greater than add_size.
@@ -93,4 +124,32 @@ public:
     bool Flush(const FlatFilePos& pos, bool finalize = false);
 };
 
+/**
+ * Cache of read-only memory mappings of the files in a FlatFileSeq, shared by
+ * all readers. Files that are still being written to may grow beyond their
+ * mapping, in which case they are mapped again.
+ */
+class FlatFileMapCache
+{
+private:
+    Mutex m_mutex;
+    std::map<int, std::shared_ptr<const FlatFileMapping>> m_mappings GUARDED_BY(m_mutex);
+
+public:
+    /**
+     * Return a mapping of the file at the given position that is at least
+     * min_size bytes long, creating it if necessary.
+     *
+     * @return The mapping, or nullptr if the file cannot be mapped or is
+     *         shorter than min_size.
+     */
+    std::shared_ptr<const FlatFileMapping> Get(const FlatFileSeq& seq, const FlatFilePos& pos, size_t min_size);
+
+    /** Forget the mapping of a file, e.g. because it is about to be deleted. */
+    void Erase(int file);
+
+    /** Forget all mappings. */
+    void Clear();
+};
+
 #endif // BITCOIN_FLATFILE_H
@@ -26,7 +26,8 @@ protected:
     {
     public:
         DB(const fs::path& path, size_t n_cache_size,
-           bool f_memory = false, bool f_wipe = false, bool f_obfuscate = false);
+           bool f_memory = false, bool f_wipe = false, bool f_obfuscate = false,
+           const std::string& name = "");
 
         /// Read block locator of the chain that the txindex is in sync with.
         bool ReadBestBlock(CBlockLocator& locator) const;
@@ -86,6 +87,9 @@ protected:
 
     virtual DB& GetDB() const = 0;
 
+    /// The last block in the chain that the index is in sync with, or null if none.
+    const CBlockIndex* CurrentIndex() const { return m_best_block_index.load(); }
+
     /// Get the name of the index for display in logs.
     virtual const char* GetName() const = 0;
 
@@ -0,0 +1,355 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <coins.h>
+#include <index/coinstatsindex.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+
+/* The index database stores the UTXO set statistics after each block. Those belonging to blocks on
+ * the active chain are indexed by height, and those belonging to blocks that have been reorganized
+ * out of the active chain are indexed by block hash, as in the block filter index.
+ *
+ * The statistics are not enough to continue after the last indexed block, as the finalized MuHash
+ * cannot be updated. The running MuHash state of that block is stored under the DB_MUHASH key and
+ * committed together with the best block locator.
+ *
+ * Keys for the height index have the type [DB_BLOCK_HEIGHT, uint32 (BE)].
+ * Keys for the hash index have the type [DB_BLOCK_HASH, uint256].
+ */
+constexpr char DB_BLOCK_HASH = 's';
+constexpr char DB_BLOCK_HEIGHT = 't';
+constexpr char DB_MUHASH = 'M';
+
+namespace {
+
+struct DBVal {
+    uint256 muhash;
+    uint64_t transaction_output_count;
+    uint64_t bogo_size;
+    CAmount total_amount;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(muhash);
+        READWRITE(transaction_output_count);
+        READWRITE(bogo_size);
+        READWRITE(total_amount);
+    }
+};
+
+struct DBHeightKey {
+    int height;
+
+    DBHeightKey() : height(0) {}
+    DBHeightKey(int height_in) : height(height_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_BLOCK_HEIGHT);
+        ser_writedata32be(s, height);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_BLOCK_HEIGHT) {
+            throw std::ios_base::failure("Invalid format for coinstatsindex DB height key");
+        }
+        height = ser_readdata32be(s);
+    }
+};
+
+struct DBHashKey {
+    uint256 hash;
+
+    DBHashKey(const uint256& hash_in) : hash(hash_in) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        char prefix = DB_BLOCK_HASH;
+        READWRITE(prefix);
+        if (prefix != DB_BLOCK_HASH) {
+            throw std::ios_base::failure("Invalid format for coinstatsindex DB hash key");
+        }
+
+        READWRITE(hash);
+    }
+};
+
+}; // namespace
+
+std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+/**
+ * The coinbases of these two blocks duplicate earlier coinbases (see BIP30)
+ * and overwrite them in the UTXO set without spending them. Their outputs are
+ * treated as unspendable, so the earlier outputs stay in the statistics.
+ */
+static bool IsBIP30Unspendable(const CBlockIndex* pindex)
+{
+    return (pindex->nHeight == 91842 && pindex->GetBlockHash() == uint256S("0x00000000000a4d0a398161ffc163c503763b1f4360639393e0e4c8e300e0caec")) ||
+           (pindex->nHeight == 91880 && pindex->GetBlockHash() == uint256S("0x00000000000743f190a18c5577a3c2d2a1f610ae9601ac046a38084ccb7cd721"));
+}
+
+CoinStatsIndex::CoinStatsIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+{
+    fs::path path = GetDataDir() / "indexes" / "coinstats";
+    fs::create_directories(path);
+
+    m_name = "coinstatsindex";
+    m_db = MakeUnique<BaseIndex::DB>(path / "db", n_cache_size, f_memory, f_wipe, false, "coinstatsindex");
+}
+
+static bool LookUpOne(const CDBWrapper& db, const CBlockIndex* block_index, DBVal& result)
+{
+    // First check if the result is stored under the height index and the value there matches the
+    // block hash. This should be the case if the block is on the active chain.
+    std::pair<uint256, DBVal> read_out;
+    if (!db.Read(DBHeightKey(block_index->nHeight), read_out)) {
+        return false;
+    }
+    if (read_out.first == block_index->GetBlockHash()) {
+        result = std::move(read_out.second);
+        return true;
+    }
+
+    // If value at the height index corresponds to an different block, the result will be stored in
+    // the hash index.
+    return db.Read(DBHashKey(block_index->GetBlockHash()), result);
+}
+
+bool CoinStatsIndex::Init()
+{
+    if (!m_db->Read(DB_MUHASH, m_muhash)) {
+        // Check that the cause of the read failure is that the key does not exist. Any other errors
+        // indicate database corruption or a disk failure, and starting the index would cause
+        // further corruption.
+        if (m_db->Exists(DB_MUHASH)) {
+            return error("%s: Cannot read current %s state; index may be corrupted",
+                         __func__, GetName());
+        }
+    }
+
+    if (!BaseIndex::Init()) return false;
+
+    const CBlockIndex* pindex = CurrentIndex();
+    if (pindex) {
+        DBVal entry;
+        if (!LookUpOne(*m_db, pindex, entry)) {
+            return error("%s: Cannot read current %s state; index may be corrupted",
+                         __func__, GetName());
+        }
+
+        uint256 muhash;
+        m_muhash.Finalize(muhash);
+        if (entry.muhash != muhash) {
+            return error("%s: Running MuHash of %s does not match block %s; index may be corrupted",
+                         __func__, GetName(), pindex->GetBlockHash().ToString());
+        }
+
+        m_transaction_output_count = entry.transaction_output_count;
+        m_bogo_size = entry.bogo_size;
+        m_total_amount = entry.total_amount;
+    }
+    return true;
+}
+
+bool CoinStatsIndex::CommitInternal(CDBBatch& batch)
+{
+    batch.Write(DB_MUHASH, m_muhash);
+    return BaseIndex::CommitInternal(batch);
+}
+
+bool CoinStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The outputs of the genesis block are not in the UTXO set.
+    if (pindex->nHeight > 0) {
+        CBlockUndo block_undo;
+        if (!UndoReadFromDisk(block_undo, pindex)) {
+            return false;
+        }
+
+        std::pair<uint256, DBVal> read_out;
+        if (!m_db->Read(DBHeightKey(pindex->nHeight - 1), read_out)) {
+            return false;
+        }
+
+        uint256 expected_block_hash = pindex->pprev->GetBlockHash();
+        if (read_out.first != expected_block_hash) {
+            return error("%s: previous block statistics belong to unexpected block %s; expected %s",
+                         __func__, read_out.first.ToString(), expected_block_hash.ToString());
+        }
+
+        for (size_t i = 0; i < block.vtx.size(); ++i) {
+            const CTransaction& tx = *block.vtx[i];
+
+            if (!(tx.IsCoinBase() && IsBIP30Unspendable(pindex))) {
+                for (uint32_t j = 0; j < tx.vout.size(); ++j) {
+                    const CTxOut& out = tx.vout[j];
+                    // Unspendable outputs are never added to the UTXO set.
+                    if (out.scriptPubKey.IsUnspendable()) continue;
+
+                    ApplyCoinHash(m_muhash, COutPoint(tx.GetHash(), j), Coin(out, pindex->nHeight, tx.IsCoinBase()));
+                    ++m_transaction_output_count;
+                    m_bogo_size += GetBogoSize(out.scriptPubKey);
+                    m_total_amount += out.nValue;
+                }
+            }
+
+            if (tx.IsCoinBase()) continue;
+
+            const CTxUndo& tx_undo = block_undo.vtxundo[i - 1];
+            for (size_t j = 0; j < tx.vin.size(); ++j) {
+                const Coin& coin = tx_undo.vprevout[j];
+                RemoveCoinHash(m_muhash, tx.vin[j].prevout, coin);
+                --m_transaction_output_count;
+                m_bogo_size -= GetBogoSize(coin.out.scriptPubKey);
+                m_total_amount -= coin.out.nValue;
+            }
+        }
+    }
+
+    std::pair<uint256, DBVal> value;
+    value.first = pindex->GetBlockHash();
+    m_muhash.Finalize(value.second.muhash);
+    value.second.transaction_output_count = m_transaction_output_count;
+    value.second.bogo_size = m_bogo_size;
+    value.second.total_amount = m_total_amount;
+
+    return m_db->Write(DBHeightKey(pindex->nHeight), value);
+}
+
+bool CoinStatsIndex::ReverseBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CBlockUndo block_undo;
+    if (!UndoReadFromDisk(block_undo, pindex)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        const CTransaction& tx = *block.vtx[i];
+
+        if (!(tx.IsCoinBase() && IsBIP30Unspendable(pindex))) {
+            for (uint32_t j = 0; j < tx.vout.size(); ++j) {
+                const CTxOut& out = tx.vout[j];
+                if (out.scriptPubKey.IsUnspendable()) continue;
+
+                RemoveCoinHash(m_muhash, COutPoint(tx.GetHash(), j), Coin(out, pindex->nHeight, tx.IsCoinBase()));
+                --m_transaction_output_count;
+                m_bogo_size -= GetBogoSize(out.scriptPubKey);
+                m_total_amount -= out.nValue;
+            }
+        }
+
+        if (tx.IsCoinBase()) continue;
+
+        const CTxUndo& tx_undo = block_undo.vtxundo[i - 1];
+        for (size_t j = 0; j < tx.vin.size(); ++j) {
+            const Coin& coin = tx_undo.vprevout[j];
+            ApplyCoinHash(m_muhash, tx.vin[j].prevout, coin);
+            ++m_transaction_output_count;
+            m_bogo_size += GetBogoSize(coin.out.scriptPubKey);
+            m_total_amount += coin.out.nValue;
+        }
+    }
+
+    // The result must match the statistics that were stored for the previous block.
+    DBVal entry;
+    if (!LookUpOne(*m_db, pindex->pprev, entry)) {
+        return error("%s: unable to read statistics of block %s",
+                     __func__, pindex->pprev->GetBlockHash().ToString());
+    }
+    uint256 muhash;
+    m_muhash.Finalize(muhash);
+    if (entry.muhash != muhash || entry.transaction_output_count != m_transaction_output_count ||
+        entry.bogo_size != m_bogo_size || entry.total_amount != m_total_amount) {
+        return error("%s: statistics after reverting block %s do not match those of its parent",
+                     __func__, pindex->GetBlockHash().ToString());
+    }
+    return true;
+}
+
+static bool CopyHeightIndexToHashIndex(CDBIterator& db_it, CDBBatch& batch,
+                                       const std::string& index_name,
+                                       int start_height, int stop_height)
+{
+    DBHeightKey key(start_height);
+    db_it.Seek(key);
+
+    for (int height = start_height; height <= stop_height; ++height) {
+        if (!db_it.GetKey(key) || key.height != height) {
+            return error("%s: unexpected key in %s: expected (%c, %d)",
+                         __func__, index_name, DB_BLOCK_HEIGHT, height);
+        }
+
+        std::pair<uint256, DBVal> value;
+        if (!db_it.GetValue(value)) {
+            return error("%s: unable to read value in %s at key (%c, %d)",
+                         __func__, index_name, DB_BLOCK_HEIGHT, height);
+        }
+
+        batch.Write(DBHashKey(value.first), std::move(value.second));
+
+        db_it.Next();
+    }
+    return true;
+}
+
+bool CoinStatsIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    // During a reorg, copy the statistics of blocks that are getting disconnected from the height
+    // index to the hash index, so they can still be looked up when the height index entries are
+    // overwritten.
+    {
+        CDBBatch batch(*m_db);
+        std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+        if (!CopyHeightIndexToHashIndex(*db_it, batch, m_name, new_tip->nHeight, current_tip->nHeight)) {
+            return false;
+        }
+        if (!m_db->WriteBatch(batch)) return false;
+    }
+
+    // Take the disconnected blocks back out of the running statistics. The new state gets written
+    // in Commit by the call to BaseIndex::Rewind.
+    const auto& consensus_params = Params().GetConsensus();
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
+            return error("%s: Failed to read block %s from disk",
+                         __func__, pindex->GetBlockHash().ToString());
+        }
+        if (!ReverseBlock(block, pindex)) {
+            return false;
+        }
+    }
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+bool CoinStatsIndex::LookUpStats(const CBlockIndex* block_index, CCoinsStats& coins_stats) const
+{
+    DBVal entry;
+    if (!LookUpOne(*m_db, block_index, entry)) {
+        return false;
+    }
+
+    coins_stats.nHeight = block_index->nHeight;
+    coins_stats.hashBlock = block_index->GetBlockHash();
+    coins_stats.nTransactionOutputs = entry.transaction_output_count;
+    coins_stats.nBogoSize = entry.bogo_size;
+    coins_stats.hashMuHash = entry.muhash;
+    coins_stats.nTotalAmount = entry.total_amount;
+    return true;
+}
@@ -24,7 +24,9 @@
 #include <util/validation.h>
 
 #include <algorithm>
+#include <functional>
 #include <queue>
+#include <unordered_map>
 #include <utility>
 
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
@@ -74,6 +76,7 @@ BlockAssembler::BlockAssembler(const CChainParams& params) : BlockAssembler(para
 void BlockAssembler::resetBlock()
 {
     inBlock.clear();
+    m_selection.clear();
 
     // Reserve space for coinbase tx
     nBlockWeight = 4000;
@@ -89,6 +92,11 @@ Optional<int64_t> BlockAssembler::m_last_block_num_txs{nullopt};
 Optional<int64_t> BlockAssembler::m_last_block_weight{nullopt};
 
 std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
+{
+    return CreateNewBlock(scriptPubKeyIn, {});
+}
+
+std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, const std::vector<SelectedTx>& prefix)
 {
     int64_t nTimeStart = GetTimeMicros();
 
@@ -134,6 +142,9 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     // transaction (which in most cases can be a no-op).
     fIncludeWitness = IsWitnessEnabled(pindexPrev, chainparams.GetConsensus());
 
+    addPrefixTxs(prefix);
+    const uint64_t nPrefixTx = nBlockTx;
+
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
     addPackageTxs(nPackagesSelected, nDescendantsUpdated);
@@ -170,7 +181,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     }
     int64_t nTime2 = GetTimeMicros();
 
-    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%u txs kept, %d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPrefixTx, nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
 
     return std::move(pblocktemplate);
 }
@@ -213,7 +224,7 @@ bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& packa
     return true;
 }
 
-void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
+void BlockAssembler::AddToBlock(CTxMemPool::txiter iter, const CFeeRate& packageFeeRate)
 {
     pblock->vtx.emplace_back(iter->GetSharedTx());
     pblocktemplate->vTxFees.push_back(iter->GetFee());
@@ -223,6 +234,7 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     nBlockSigOpsCost += iter->GetSigOpCost();
     nFees += iter->GetFee();
     inBlock.insert(iter);
+    m_selection.push_back(SelectedTx{iter->GetTx().GetHash(), packageFeeRate});
 
     bool fPrintPriority = gArgs.GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
     if (fPrintPriority) {
@@ -412,8 +424,9 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         std::vector<CTxMemPool::txiter> sortedEntries;
         SortForBlock(ancestors, sortedEntries);
 
+        const CFeeRate packageFeeRate(packageFees, packageSize);
         for (size_t i=0; i<sortedEntries.size(); ++i) {
-            AddToBlock(sortedEntries[i]);
+            AddToBlock(sortedEntries[i], packageFeeRate);
             // Erase from the modified set, if present
             mapModifiedTx.erase(sortedEntries[i]);
         }
@@ -425,6 +438,112 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     }
 }
 
+// A prefix of a valid block ordering is itself valid, so the prefix is
+// followed until the first transaction that left the mempool, or whose
+// in-mempool parents are not all in the block anymore. The transactions
+// were tested for finality and fit the block limits when they were first
+// selected on the same tip, but check again to be safe.
+void BlockAssembler::addPrefixTxs(const std::vector<SelectedTx>& prefix)
+{
+    for (const SelectedTx& selected : prefix) {
+        CTxMemPool::txiter iter = mempool.mapTx.find(selected.txid);
+        if (iter == mempool.mapTx.end()) {
+            return;
+        }
+        for (CTxMemPool::txiter parent : mempool.GetMemPoolParents(iter)) {
+            if (!inBlock.count(parent)) return;
+        }
+        if (!TestPackage(iter->GetTxSize(), iter->GetSigOpCost()) || !TestPackageTransactions({iter})) {
+            return;
+        }
+        AddToBlock(iter, selected.package_feerate);
+    }
+}
+
+BlockTemplateBuilder::BlockTemplateBuilder(const CChainParams& params, const BlockAssembler::Options& options) : m_chainparams(params), m_options(options)
+{
+    m_conn_entry_added = mempool.NotifyEntryAdded.connect(std::bind(&BlockTemplateBuilder::TransactionAddedToMempool, this, std::placeholders::_1));
+}
+
+BlockTemplateBuilder::BlockTemplateBuilder(const CChainParams& params) : BlockTemplateBuilder(params, DefaultOptions()) {}
+
+void BlockTemplateBuilder::TransactionAddedToMempool(const CTransactionRef& tx)
+{
+    LOCK(m_mutex);
+    if (m_rebuild) return;
+    if (m_added.size() >= MAX_ADDED_TRACKED) {
+        m_rebuild = true;
+        m_added.clear();
+        return;
+    }
+    m_added.push_back(tx->GetHash());
+}
+
+size_t BlockTemplateBuilder::ReusablePrefixLength(const CBlockIndex* pindexPrev)
+{
+    if (m_rebuild || m_tip_hash != pindexPrev->GetBlockHash()) {
+        return 0;
+    }
+
+    std::unordered_map<uint256, size_t, SaltedTxidHasher> position;
+    for (size_t i = 0; i < m_selection.size(); ++i) {
+        position.emplace(m_selection[i].txid, i);
+    }
+    auto kept = [&](const uint256& txid, size_t nKeep) {
+        auto it = position.find(txid);
+        return it != position.end() && it->second < nKeep;
+    };
+
+    size_t nKeep = m_selection.size();
+    for (const uint256& txid : m_added) {
+        CTxMemPool::txiter iter = mempool.mapTx.find(txid);
+        if (iter == mempool.mapTx.end() || kept(txid, nKeep)) continue;
+
+        // Feerate of the package the added transaction would be selected in
+        CTxMemPool::setEntries ancestors;
+        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        mempool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        CAmount packageFees = iter->GetModifiedFee();
+        uint64_t packageSize = iter->GetTxSize();
+        for (CTxMemPool::txiter ancestor : ancestors) {
+            if (kept(ancestor->GetTx().GetHash(), nKeep)) continue;
+            packageFees += ancestor->GetModifiedFee();
+            packageSize += ancestor->GetTxSize();
+        }
+        const CFeeRate packageFeeRate(packageFees, packageSize);
+
+        // Select everything again from the first package it outbids on
+        for (size_t i = 0; i < nKeep; ++i) {
+            if (m_selection[i].package_feerate < packageFeeRate) {
+                nKeep = i;
+                break;
+            }
+        }
+    }
+    return nKeep;
+}
+
+std::unique_ptr<CBlockTemplate> BlockTemplateBuilder::CreateNewBlock(const CScript& scriptPubKeyIn)
+{
+    LOCK2(cs_main, mempool.cs);
+    LOCK(m_mutex);
+    const CBlockIndex* pindexPrev = ::ChainActive().Tip();
+    const std::vector<SelectedTx> prefix(m_selection.begin(), m_selection.begin() + ReusablePrefixLength(pindexPrev));
+
+    // Start from scratch next time if this one fails
+    m_rebuild = true;
+    m_added.clear();
+
+    BlockAssembler assembler(m_chainparams, m_options);
+    std::unique_ptr<CBlockTemplate> pblocktemplate = assembler.CreateNewBlock(scriptPubKeyIn, prefix);
+
+    m_rebuild = false;
+    m_tip_hash = pindexPrev->GetBlockHash();
+    m_selection = assembler.GetSelection();
+    return pblocktemplate;
+}
+
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
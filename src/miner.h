@@ -7,7 +7,9 @@
 #define BITCOIN_MINER_H
 
 #include <optional.h>
+#include <policy/feerate.h>
 #include <primitives/block.h>
+#include <sync.h>
 #include <txmempool.h>
 #include <validation.h>
 
@@ -33,6 +35,13 @@ struct CBlockTemplate
     std::vector<unsigned char> vchCoinbaseCommitment;
 };
 
+/** A transaction in a block template, with the feerate of the package it was selected in */
+struct SelectedTx
+{
+    uint256 txid;
+    CFeeRate package_feerate;
+};
+
 // Container for tracking updates to ancestor feerate as we include (parent)
 // transactions in a block
 struct CTxMemPoolModifiedEntry {
@@ -142,6 +151,7 @@ private:
     uint64_t nBlockSigOpsCost;
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
+    std::vector<SelectedTx> m_selection;
 
     // Chain context for the block
     int nHeight;
@@ -160,6 +170,13 @@ public:
 
     /** Construct a new block template with coinbase to scriptPubKeyIn */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn);
+    /** Construct a new block template with coinbase to scriptPubKeyIn, starting
+     *  with the transactions of prefix for as long as they are still in the
+     *  mempool with all their in-mempool parents before them */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, const std::vector<SelectedTx>& prefix);
+
+    /** The transactions of the last constructed block, in block order, without the coinbase */
+    const std::vector<SelectedTx>& GetSelection() const { return m_selection; }
 
     static Optional<int64_t> m_last_block_num_txs;
     static Optional<int64_t> m_last_block_weight;
@@ -169,7 +186,9 @@ private:
     /** Clear the block's state and prepare for assembling a new block */
     void resetBlock();
     /** Add a tx to the block */
-    void AddToBlock(CTxMemPool::txiter iter);
+    void AddToBlock(CTxMemPool::txiter iter, const CFeeRate& packageFeeRate);
+    /** Add the still valid leading part of a previous selection to the block */
+    void addPrefixTxs(const std::vector<SelectedTx>& prefix) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
 
     // Methods for how to add transactions to a block.
     /** Add transactions based on feerate including unconfirmed ancestors
@@ -198,6 +217,45 @@ private:
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
 };
 
+/**
+ * Builds block templates incrementally. It keeps the transaction selection of
+ * the last template and records the transactions added to the mempool since.
+ * As long as the tip does not change, a new template starts with the part of
+ * the old selection that none of the added transactions outbid and that is
+ * still in the mempool, so only the rest of the block has to be selected again.
+ */
+class BlockTemplateBuilder
+{
+private:
+    //! Number of added transactions to track before falling back to a full selection
+    static constexpr size_t MAX_ADDED_TRACKED = 10000;
+
+    const CChainParams& m_chainparams;
+    const BlockAssembler::Options m_options;
+    boost::signals2::scoped_connection m_conn_entry_added;
+
+    Mutex m_mutex;
+    //! Whether the next template has to be selected from scratch
+    bool m_rebuild GUARDED_BY(m_mutex){true};
+    //! Tip the last template was built on
+    uint256 m_tip_hash GUARDED_BY(m_mutex);
+    //! Transactions of the last template, in block order
+    std::vector<SelectedTx> m_selection GUARDED_BY(m_mutex);
+    //! Transactions added to the mempool since the last template
+    std::vector<uint256> m_added GUARDED_BY(m_mutex);
+
+    void TransactionAddedToMempool(const CTransactionRef& tx);
+    /** Number of transactions at the start of m_selection the next template can keep */
+    size_t ReusablePrefixLength(const CBlockIndex* pindexPrev) EXCLUSIVE_LOCKS_REQUIRED(cs_main, mempool.cs, m_mutex);
+
+public:
+    BlockTemplateBuilder(const CChainParams& params, const BlockAssembler::Options& options);
+    explicit BlockTemplateBuilder(const CChainParams& params);
+
+    /** Construct a new block template with coinbase to scriptPubKeyIn */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn);
+};
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
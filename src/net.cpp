@@ -31,6 +31,10 @@
 #include <poll.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -70,6 +74,12 @@ enum BindFlags {
 // The sleep time needs to be small to avoid new sockets stalling
 static const uint64_t SELECT_TIMEOUT_MILLISECONDS = 50;
 
+#ifdef USE_EPOLL
+// Maximum number of socket events handled per epoll_wait call; sockets that
+// are still ready are reported again by the next call
+static const int MAX_EPOLL_EVENTS = 256;
+#endif
+
 const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
@@ -80,6 +90,7 @@ static const uint64_t RANDOMIZER_ID_LOCALHOSTNONCE = 0xd93e69e2bbfa5735ULL; // S
 bool fDiscover = true;
 bool fListen = true;
 bool g_relay_txes = !DEFAULT_BLOCKSONLY;
+CRecvBufferPool g_recv_buffer_pool(MAX_RECV_POOL_BYTES);
 CCriticalSection cs_mapLocalHost;
 std::map<CNetAddr, LocalServiceInfo> mapLocalHost GUARDED_BY(cs_mapLocalHost);
 static bool vfLimited[NET_MAX] GUARDED_BY(cs_mapLocalHost) = {};
@@ -564,7 +575,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
         // get current incomplete message, or create a new one
         if (vRecvMsg.empty() ||
             vRecvMsg.back().complete())
-            vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION));
+            vRecvMsg.emplace_back(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
 
         CNetMessage& msg = vRecvMsg.back();
 
@@ -603,6 +614,14 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
     return true;
 }
 
+char* CNode::GetRecvBuffer(unsigned int nSize)
+{
+    LOCK(cs_vRecv);
+    if (vRecvMsg.empty() || vRecvMsg.back().complete())
+        return nullptr;
+    return vRecvMsg.back().GetDataBuffer(nSize);
+}
+
 void CNode::SetSendVersion(int nVersionIn)
 {
     // Send version may only be changed in the version message, and
@@ -630,6 +649,57 @@ int CNode::GetSendVersion() const
 }
 
 
+CSerializeData CRecvBufferPool::Get(size_t nSize)
+{
+    CSerializeData buf;
+    // the smallest class whose buffers are all large enough
+    int nClass = 0;
+    while (nClass < NUM_CLASSES && (MIN_BUFFER_SIZE << nClass) < nSize)
+        nClass++;
+    LOCK(cs);
+    for (; nClass < NUM_CLASSES; nClass++) {
+        if (!vFree[nClass].empty()) {
+            buf.swap(vFree[nClass].back());
+            vFree[nClass].pop_back();
+            nPooledBytes -= buf.capacity();
+            nPooledBuffers--;
+            break;
+        }
+    }
+    return buf;
+}
+
+void CRecvBufferPool::Put(CSerializeData&& buf)
+{
+    const size_t nCapacity = buf.capacity();
+    if (nCapacity < MIN_BUFFER_SIZE)
+        return;
+    // the largest class whose size the buffer can hold
+    int nClass = 0;
+    while (nClass + 1 < NUM_CLASSES && (MIN_BUFFER_SIZE << (nClass + 1)) <= nCapacity)
+        nClass++;
+    LOCK(cs);
+    if (nPooledBytes + nCapacity > nMaxPooledBytes)
+        return;
+    // Received data is public, so there is no need to wipe it before reuse.
+    buf.clear();
+    vFree[nClass].push_back(std::move(buf));
+    nPooledBytes += nCapacity;
+    nPooledBuffers++;
+}
+
+size_t CRecvBufferPool::GetPooledBytes() const
+{
+    LOCK(cs);
+    return nPooledBytes;
+}
+
+size_t CRecvBufferPool::GetPooledBuffers() const
+{
+    LOCK(cs);
+    return nPooledBuffers;
+}
+
 int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
 {
     // copy data to temporary parsing buffer
@@ -658,6 +728,13 @@ int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
     // switch state to reading message data
     in_data = true;
 
+    // take a buffer for large bodies from the pool, if it has one
+    if (hdr.nMessageSize >= CRecvBufferPool::MIN_BUFFER_SIZE && hdr.nMessageSize <= MAX_PROTOCOL_MESSAGE_LENGTH) {
+        CSerializeData buf = g_recv_buffer_pool.Get(hdr.nMessageSize);
+        if (buf.capacity() > 0)
+            vRecv.SwapData(buf);
+    }
+
     return nCopy;
 }
 
@@ -672,12 +749,26 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     }
 
     hasher.Write((const unsigned char*)pch, nCopy);
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    // the data was received in place if it came from GetDataBuffer
+    if (pch != &vRecv[nDataPos])
+        memcpy(&vRecv[nDataPos], pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
 }
 
+char* CNetMessage::GetDataBuffer(unsigned int nSize)
+{
+    if (!in_data || hdr.nMessageSize > MAX_PROTOCOL_MESSAGE_LENGTH || hdr.nMessageSize - nDataPos < nSize)
+        return nullptr;
+
+    if (vRecv.size() < nDataPos + nSize) {
+        // Same allocation policy as readData
+        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nSize + 256 * 1024));
+    }
+    return &vRecv[nDataPos];
+}
+
 const uint256& CNetMessage::GetMessageHash() const
 {
     assert(complete());
@@ -1245,10 +1336,72 @@ void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_s
 }
 #endif
 
+#ifdef USE_EPOLL
+void CConnman::SocketEventsEpoll(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+{
+    // Sockets stay registered until they are closed, so only changes in what
+    // we wait for cost a system call. The listening sockets are registered
+    // once by ThreadSocketHandler.
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes)
+        {
+            // Same logic as in GenerateSelectSet: wait until data can be
+            // sent if there is any, otherwise until data can be received
+            // if there is space in the receive buffer. Errors and hangups
+            // are always reported.
+            bool select_recv = !pnode->fPauseRecv;
+            bool select_send;
+            {
+                LOCK(pnode->cs_vSend);
+                select_send = !pnode->vSendMsg.empty();
+            }
+            const uint32_t events = select_send ? EPOLLOUT : (select_recv ? EPOLLIN : 0);
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            if (pnode->m_epoll_registered && pnode->m_epoll_events == events)
+                continue;
+
+            struct epoll_event event = {};
+            event.events = events;
+            event.data.fd = pnode->hSocket;
+            if (epoll_ctl(m_epoll_fd, pnode->m_epoll_registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+                LogPrint(BCLog::NET, "epoll_ctl failed for peer=%d: %s\n", pnode->GetId(), NetworkErrorString(WSAGetLastError()));
+                continue;
+            }
+            pnode->m_epoll_registered = true;
+            pnode->m_epoll_events = events;
+        }
+    }
+
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int n_events = epoll_wait(m_epoll_fd, events, MAX_EPOLL_EVENTS, SELECT_TIMEOUT_MILLISECONDS);
+    if (n_events < 0) return;
+
+    if (interruptNet) return;
+
+    for (int i = 0; i < n_events; i++) {
+        if (events[i].events & EPOLLIN)             recv_set.insert(events[i].data.fd);
+        if (events[i].events & EPOLLOUT)            send_set.insert(events[i].data.fd);
+        if (events[i].events & (EPOLLERR|EPOLLHUP)) error_set.insert(events[i].data.fd);
+    }
+}
+#endif
+
 void CConnman::SocketHandler()
 {
     std::set<SOCKET> recv_set, send_set, error_set;
+#ifdef USE_EPOLL
+    if (m_epoll_fd != -1) {
+        SocketEventsEpoll(recv_set, send_set, error_set);
+    } else {
+        SocketEvents(recv_set, send_set, error_set);
+    }
+#else
     SocketEvents(recv_set, send_set, error_set);
+#endif
 
     if (interruptNet) return;
 
@@ -1296,17 +1449,21 @@ void CConnman::SocketHandler()
         {
             // typical socket buffer is 8K-64K
             char pchBuf[0x10000];
+            // the bodies of large messages are received in place
+            char* pchRecv = pnode->GetRecvBuffer(sizeof(pchBuf));
+            if (!pchRecv)
+                pchRecv = pchBuf;
             int nBytes = 0;
             {
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+                nBytes = recv(pnode->hSocket, pchRecv, sizeof(pchBuf), MSG_DONTWAIT);
             }
             if (nBytes > 0)
             {
                 bool notify = false;
-                if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
+                if (!pnode->ReceiveMsgBytes(pchRecv, nBytes, notify))
                     pnode->CloseSocketDisconnect();
                 RecordBytesRecv(nBytes);
                 if (notify) {
@@ -1370,21 +1527,47 @@ void CConnman::SocketHandler()
 
 void CConnman::ThreadSocketHandler()
 {
+#ifdef USE_EPOLL
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd == -1) {
+        LogPrintf("Unable to create epoll instance, falling back to poll: %s\n", NetworkErrorString(WSAGetLastError()));
+    }
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        if (m_epoll_fd == -1 || hListenSocket.socket == INVALID_SOCKET)
+            continue;
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = hListenSocket.socket;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, hListenSocket.socket, &event) != 0) {
+            LogPrintf("Unable to add listening socket to epoll instance, falling back to poll: %s\n", NetworkErrorString(WSAGetLastError()));
+            close(m_epoll_fd);
+            m_epoll_fd = -1;
+        }
+    }
+#endif
+
     while (!interruptNet)
     {
         DisconnectNodes();
         NotifyNumConnectionsChanged();
         SocketHandler();
     }
+
+#ifdef USE_EPOLL
+    if (m_epoll_fd != -1) {
+        close(m_epoll_fd);
+        m_epoll_fd = -1;
+    }
+#endif
 }
 
 void CConnman::WakeMessageHandler()
 {
     {
         std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+        nMsgProcWake++;
     }
-    condMsgProc.notify_one();
+    condMsgProc.notify_all();
 }
 
 
@@ -1942,8 +2125,9 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     }
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(int nWorker)
 {
+    uint64_t nWakeSeen = WITH_LOCK(mutexMsgProc, return nMsgProcWake);
     while (!flagInterruptMsgProc)
     {
         std::vector<CNode*> vNodesCopy;
@@ -1957,24 +2141,31 @@ void CConnman::ThreadMessageHandler()
 
         bool fMoreWork = false;
 
-        for (CNode* pnode : vNodesCopy)
+        // Every worker starts at a different node, so that they do not all
+        // compete for the same ones. Nodes that are owned by another worker
+        // are skipped; that worker reports whether they have more work.
+        const size_t nNodes = vNodesCopy.size();
+        const size_t nOffset = nNodes * nWorker / nMessageHandlerThreads;
+        for (size_t i = 0; i < nNodes && !flagInterruptMsgProc; i++)
         {
+            CNode* pnode = vNodesCopy[(nOffset + i) % nNodes];
             if (pnode->fDisconnect)
                 continue;
 
+            bool fOwned = false;
+            if (!pnode->fMsgProcOwned.compare_exchange_strong(fOwned, true))
+                continue;
+
             // Receive messages
             bool fMoreNodeWork = m_msgproc->ProcessMessages(pnode, flagInterruptMsgProc);
             fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
-            if (flagInterruptMsgProc)
-                return;
             // Send messages
-            {
+            if (!flagInterruptMsgProc) {
                 LOCK(pnode->cs_sendProcessing);
                 m_msgproc->SendMessages(pnode);
             }
 
-            if (flagInterruptMsgProc)
-                return;
+            pnode->fMsgProcOwned = false;
         }
 
         {
@@ -1985,9 +2176,9 @@ void CConnman::ThreadMessageHandler()
 
         WAIT_LOCK(mutexMsgProc, lock);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake; });
+            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [&] { return nMsgProcWake != nWakeSeen; });
         }
-        fMsgProcWake = false;
+        nWakeSeen = nMsgProcWake;
     }
 }
 
@@ -2239,11 +2430,6 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     interruptNet.reset();
     flagInterruptMsgProc = false;
 
-    {
-        LOCK(mutexMsgProc);
-        fMsgProcWake = false;
-    }
-
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
 
@@ -2267,7 +2453,11 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this, connOptions.m_specified_outgoing)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int i = 0; i < nMessageHandlerThreads; i++) {
+        // The thread name must outlive TraceThread, so it is owned by the lambda
+        std::string name = i == 0 ? "msghand" : strprintf("msghand.%d", i);
+        threadMessageHandlers.emplace_back([this, i, name] { TraceThread(name.c_str(), std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this, i))); });
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(std::bind(&CConnman::DumpAddresses, this), DUMP_PEERS_INTERVAL * 1000);
@@ -2316,8 +2506,11 @@ void CConnman::Interrupt()
 
 void CConnman::Stop()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (std::thread& thread : threadMessageHandlers) {
+        if (thread.joinable())
+            thread.join();
+    }
+    threadMessageHandlers.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
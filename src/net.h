@@ -81,6 +81,10 @@ static const int64_t DEFAULT_PEER_CONNECT_TIMEOUT = 60;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** -msghandlerthreads default */
+static const int DEFAULT_MESSAGE_HANDLER_THREADS = 1;
+/** Maximum number of message handler threads */
+static const int MAX_MESSAGE_HANDLER_THREADS = 16;
 
 typedef int64_t NodeId;
 
@@ -128,6 +132,7 @@ public:
         int nMaxOutbound = 0;
         int nMaxAddnode = 0;
         int nMaxFeeler = 0;
+        int nMessageHandlerThreads = DEFAULT_MESSAGE_HANDLER_THREADS;
         int nBestHeight = 0;
         CClientUIInterface* uiInterface = nullptr;
         NetEventsInterface* m_msgproc = nullptr;
@@ -152,6 +157,7 @@ public:
         m_use_addrman_outgoing = connOptions.m_use_addrman_outgoing;
         nMaxAddnode = connOptions.nMaxAddnode;
         nMaxFeeler = connOptions.nMaxFeeler;
+        nMessageHandlerThreads = std::max(1, std::min(connOptions.nMessageHandlerThreads, MAX_MESSAGE_HANDLER_THREADS));
         nBestHeight = connOptions.nBestHeight;
         clientInterface = connOptions.uiInterface;
         m_banman = connOptions.m_banman;
@@ -327,13 +333,16 @@ private:
     void AddOneShot(const std::string& strDest);
     void ProcessOneShot();
     void ThreadOpenConnections(std::vector<std::string> connect);
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int nWorker);
     void AcceptConnection(const ListenSocket& hListenSocket);
     void DisconnectNodes();
     void NotifyNumConnectionsChanged();
     void InactivityCheck(CNode *pnode);
     bool GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+#ifdef USE_EPOLL
+    void SocketEventsEpoll(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+#endif
     void SocketHandler();
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
@@ -408,6 +417,7 @@ private:
     int nMaxOutbound;
     int nMaxAddnode;
     int nMaxFeeler;
+    int nMessageHandlerThreads;
     bool m_use_addrman_outgoing;
     std::atomic<int> nBestHeight;
     CClientUIInterface* clientInterface;
@@ -417,8 +427,8 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
+    /** counter for waking the message processors; each one waits for it to change. */
+    uint64_t nMsgProcWake{0};
 
     std::condition_variable condMsgProc;
     Mutex mutexMsgProc;
@@ -426,11 +436,16 @@ private:
 
     CThreadInterrupt interruptNet;
 
+#ifdef USE_EPOLL
+    /** epoll instance of the socket handler thread, or -1 if the poll/select fallback is used. */
+    int m_epoll_fd{-1};
+#endif
+
     std::thread threadDNSAddressSeed;
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
 
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of nMaxOutbound
@@ -571,6 +586,48 @@ public:
 
 
 
+/**
+ * Pool of buffers for the bodies of large received messages.
+ *
+ * Buffers are kept in size classes (slabs) of powers of two, starting at
+ * MIN_BUFFER_SIZE. A message that is large enough takes a buffer from the
+ * pool when its header has been received and returns it when it has been
+ * processed, so that peers sending blocks do not cause the same memory to
+ * be allocated, zeroed and freed over and over.
+ */
+class CRecvBufferPool
+{
+public:
+    //! Smallest buffer that is worth pooling
+    static const size_t MIN_BUFFER_SIZE = 64 * 1024;
+    //! Number of size classes, from MIN_BUFFER_SIZE up to 4 MiB
+    static const int NUM_CLASSES = 7;
+
+    explicit CRecvBufferPool(size_t nMaxPooledBytesIn) : nMaxPooledBytes(nMaxPooledBytesIn) {}
+
+    //! Take an empty buffer with room for at least nSize bytes from the pool, or return an empty buffer without capacity if there is none.
+    CSerializeData Get(size_t nSize);
+    //! Give a buffer back to the pool. It is freed instead when it is too small or the pool is full.
+    void Put(CSerializeData&& buf);
+
+    //! Total capacity of the buffers in the pool
+    size_t GetPooledBytes() const;
+    //! Number of buffers in the pool
+    size_t GetPooledBuffers() const;
+
+private:
+    const size_t nMaxPooledBytes;
+    mutable Mutex cs;
+    std::vector<CSerializeData> vFree[NUM_CLASSES] GUARDED_BY(cs);
+    size_t nPooledBytes GUARDED_BY(cs){0};
+    size_t nPooledBuffers GUARDED_BY(cs){0};
+};
+
+/** Maximum total size of the buffers kept in g_recv_buffer_pool */
+static const size_t MAX_RECV_POOL_BYTES = 32 * 1024 * 1024;
+
+extern CRecvBufferPool g_recv_buffer_pool;
+
 class CNetMessage {
 private:
     mutable CHash256 hasher;
@@ -595,6 +652,16 @@ public:
         nTime = 0;
     }
 
+    CNetMessage(const CNetMessage&) = delete;
+    CNetMessage& operator=(const CNetMessage&) = delete;
+
+    ~CNetMessage()
+    {
+        CSerializeData buf;
+        vRecv.SwapData(buf);
+        g_recv_buffer_pool.Put(std::move(buf));
+    }
+
     bool complete() const
     {
         if (!in_data)
@@ -612,6 +679,9 @@ public:
 
     int readHeader(const char *pch, unsigned int nBytes);
     int readData(const char *pch, unsigned int nBytes);
+
+    //! Return where the next nSize bytes of the body go, if they all belong to it; nullptr otherwise.
+    char* GetDataBuffer(unsigned int nSize);
 };
 
 
@@ -678,10 +748,19 @@ public:
     mutable CCriticalSection cs_filter;
     std::unique_ptr<CBloomFilter> pfilter PT_GUARDED_BY(cs_filter);
     std::atomic<int> nRefCount{0};
+    // Set while a message handler thread processes messages of this node, so
+    // that no other one does at the same time
+    std::atomic_bool fMsgProcOwned{false};
 
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv{false};
     std::atomic_bool fPauseSend{false};
+#ifdef USE_EPOLL
+    // Whether, and for which events, the socket is registered with the epoll
+    // instance. Only used by the socket handler thread.
+    bool m_epoll_registered{false};
+    uint32_t m_epoll_events{0};
+#endif
 
 protected:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
@@ -783,6 +862,14 @@ public:
 
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete);
 
+    /**
+     * Return a buffer of nSize bytes inside the body of the message that is
+     * being received, if the next nSize bytes all belong to it, so that they
+     * can be received in place and passed to ReceiveMsgBytes. Returns nullptr
+     * otherwise. Only to be used by the thread that calls ReceiveMsgBytes.
+     */
+    char* GetRecvBuffer(unsigned int nSize);
+
     void SetRecvVersion(int nVersionIn)
     {
         nRecvVersion = nVersionIn;
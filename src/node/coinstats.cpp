@@ -0,0 +1,204 @@
+// Copyright (c) 2010 Satoshi Nakamoto
+// Copyright (c) 2009-2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/coinstats.h>
+
+#include <coins.h>
+#include <crypto/muhash.h>
+#include <hash.h>
+#include <serialize.h>
+#include <shutdown.h>
+#include <streams.h>
+#include <sync.h>
+#include <txdb.h>
+#include <util/system.h>
+#include <util/threadnames.h>
+#include <validation.h>
+#include <version.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! Number of ranges the UTXO set is scanned in; the first byte of the transaction hash selects the range.
+static const int UTXO_STATS_PARTITIONS = 256;
+
+namespace {
+
+//! Result of scanning one range of the UTXO set
+struct Partition {
+    CCoinsStats stats;
+    //! The serialization of the range, in the order it is hashed
+    std::vector<unsigned char> data;
+    bool fDone = false;
+    bool fOk = false;
+};
+
+} // namespace
+
+uint64_t GetBogoSize(const CScript& scriptPubKey)
+{
+    return 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+           2 /* scriptPubKey len */ + scriptPubKey.size() /* scriptPubKey */;
+}
+
+//! Serialize an unspent output as an element of the rolling UTXO set hash.
+static CDataStream TxOutSer(const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << outpoint;
+    ss << static_cast<uint32_t>(coin.nHeight * 2 + coin.fCoinBase);
+    ss << coin.out;
+    return ss;
+}
+
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss = TxOutSer(outpoint, coin);
+    muhash.Insert(Span<const unsigned char>((const unsigned char*)ss.data(), ss.size()));
+}
+
+void RemoveCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss = TxOutSer(outpoint, coin);
+    muhash.Remove(Span<const unsigned char>((const unsigned char*)ss.data(), ss.size()));
+}
+
+template <typename Stream>
+static void ApplyStats(CCoinsStats& stats, Stream& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    assert(!outputs.empty());
+    ss << hash;
+    ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase ? 1u : 0u);
+    stats.nTransactions++;
+    for (const auto& output : outputs) {
+        ss << VARINT(output.first + 1);
+        ss << output.second.out.scriptPubKey;
+        ss << VARINT(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
+        stats.nTransactionOutputs++;
+        stats.nTotalAmount += output.second.out.nValue;
+        stats.nBogoSize += GetBogoSize(output.second.out.scriptPubKey);
+    }
+    ss << VARINT(0u);
+}
+
+//! Scan the transactions from the cursor on whose hash starts with a byte below nEnd.
+static bool ScanPartition(CCoinsViewCursor& cursor, int nEnd, Partition& partition, const std::atomic<bool>& fAbort)
+{
+    CVectorWriter ss(SER_GETHASH, PROTOCOL_VERSION, partition.data, 0);
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
+    while (cursor.Valid()) {
+        // The scan can take minutes; do not hold up shutdown.
+        if (fAbort || ShutdownRequested()) return false;
+        COutPoint key;
+        Coin coin;
+        if (cursor.GetKey(key) && cursor.GetValue(coin)) {
+            if (*key.hash.begin() >= nEnd) break;
+            if (!outputs.empty() && key.hash != prevkey) {
+                ApplyStats(partition.stats, ss, prevkey, outputs);
+                outputs.clear();
+            }
+            prevkey = key.hash;
+            outputs[key.n] = std::move(coin);
+        } else {
+            return error("%s: unable to read value", __func__);
+        }
+        cursor.Next();
+    }
+    if (!outputs.empty()) {
+        ApplyStats(partition.stats, ss, prevkey, outputs);
+    }
+    return true;
+}
+
+bool GetUTXOStats(CCoinsViewDB* view, CCoinsStats& stats, int nThreads)
+{
+    nThreads = std::max(1, std::min(nThreads, UTXO_STATS_PARTITIONS));
+
+    std::vector<uint256> starts(UTXO_STATS_PARTITIONS);
+    for (int i = 0; i < UTXO_STATS_PARTITIONS; ++i) {
+        *starts[i].begin() = i;
+    }
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors = view->Cursors(starts);
+    stats.hashBlock = cursors.front()->GetBestBlock();
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindex = LookupBlockIndex(stats.hashBlock);
+        if (!pindex) return error("%s: unknown best block %s", __func__, stats.hashBlock.ToString());
+        stats.nHeight = pindex->nHeight;
+    }
+
+    std::vector<Partition> partitions(UTXO_STATS_PARTITIONS);
+    std::mutex mutex;
+    std::condition_variable cond;
+    int nNext = 0;
+    int nHashed = 0;
+    std::atomic<bool> fAbort{false};
+
+    auto worker = [&]() {
+        util::ThreadRename("utxostats");
+        while (true) {
+            int i;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                // Bound the memory held by ranges that are scanned but not hashed yet.
+                cond.wait(lock, [&] { return fAbort || nNext == UTXO_STATS_PARTITIONS || nNext < nHashed + 2 * nThreads; });
+                if (fAbort || nNext == UTXO_STATS_PARTITIONS) return;
+                i = nNext++;
+            }
+            bool fOk = ScanPartition(*cursors[i], i + 1, partitions[i], fAbort);
+            cursors[i].reset();
+            std::unique_lock<std::mutex> lock(mutex);
+            partitions[i].fOk = fOk;
+            partitions[i].fDone = true;
+            cond.notify_all();
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; ++i) {
+        threads.emplace_back(worker);
+    }
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << stats.hashBlock;
+    bool fOk = true;
+    for (int i = 0; i < UTXO_STATS_PARTITIONS && fOk; ++i) {
+        Partition& partition = partitions[i];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&] { return partition.fDone; });
+        }
+        fOk = partition.fOk;
+        ss.write((const char*)partition.data.data(), partition.data.size());
+        std::vector<unsigned char>().swap(partition.data);
+        stats.nTransactions += partition.stats.nTransactions;
+        stats.nTransactionOutputs += partition.stats.nTransactionOutputs;
+        stats.nBogoSize += partition.stats.nBogoSize;
+        stats.nTotalAmount += partition.stats.nTotalAmount;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        nHashed = i + 1;
+        cond.notify_all();
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        fAbort = true;
+        cond.notify_all();
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    if (!fOk) return false;
+
+    stats.hashSerialized = ss.GetHash();
+    stats.nDiskSize = view->EstimateSize();
+    return true;
+}
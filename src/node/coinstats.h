@@ -0,0 +1,56 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_COINSTATS_H
+#define BITCOIN_NODE_COINSTATS_H
+
+#include <amount.h>
+#include <uint256.h>
+
+#include <cstdint>
+
+class CCoinsViewDB;
+class COutPoint;
+class CScript;
+class Coin;
+class MuHash3072;
+
+//! Maximum number of threads to scan the UTXO set with
+static const int MAX_UTXO_STATS_THREADS = 16;
+
+struct CCoinsStats
+{
+    int nHeight;
+    uint256 hashBlock;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nBogoSize;
+    uint256 hashSerialized;
+    //! Order-independent hash of the set, only maintained by the coin statistics index
+    uint256 hashMuHash;
+    uint64_t nDiskSize;
+    CAmount nTotalAmount;
+
+    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
+};
+
+/**
+ * Calculate statistics about the unspent transaction output set.
+ *
+ * The set is split into ranges of transaction hashes, which are scanned on
+ * up to nThreads threads. Their serializations are hashed in order, so the
+ * result does not depend on the number of threads.
+ */
+bool GetUTXOStats(CCoinsViewDB* view, CCoinsStats& stats, int nThreads = 1);
+
+//! Size of an unspent output in the bogosize metric.
+uint64_t GetBogoSize(const CScript& scriptPubKey);
+
+//! Add an unspent output to a rolling hash of the UTXO set.
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+
+//! Remove an unspent output from a rolling hash of the UTXO set.
+void RemoveCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+
+#endif // BITCOIN_NODE_COINSTATS_H
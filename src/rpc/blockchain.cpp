@@ -12,23 +12,30 @@
 #include <coins.h>
 #include <consensus/validation.h>
 #include <core_io.h>
+#include <crypto/siphash.h>
+#include <dbwrapper.h>
 #include <hash.h>
 #include <index/blockfilterindex.h>
+#include <index/coinstatsindex.h>
 #include <key_io.h>
+#include <node/coinstats.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
-#include <policy/rbf.h>
 #include <primitives/transaction.h>
+#include <random.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
 #include <script/descriptor.h>
+#include <shutdown.h>
 #include <streams.h>
 #include <sync.h>
 #include <txdb.h>
 #include <txmempool.h>
 #include <undo.h>
+#include <util/rbf.h>
 #include <util/strencodings.h>
 #include <util/system.h>
+#include <util/threadnames.h>
 #include <util/validation.h>
 #include <validation.h>
 #include <validationinterface.h>
@@ -42,8 +49,10 @@
 
 #include <boost/thread/thread.hpp> // boost::thread::interrupt
 
+#include <limits>
 #include <memory>
 #include <mutex>
+#include <thread>
 #include <condition_variable>
 
 struct CUpdatedBlock
@@ -414,36 +423,35 @@ static std::string EntryDescriptionString()
            "    \"bip125-replaceable\" : true|false,  (boolean) Whether this transaction could be replaced due to BIP125 (replace-by-fee)\n";
 }
 
-static void entryToJSON(const CTxMemPool& pool, UniValue& info, const CTxMemPoolEntry& e) EXCLUSIVE_LOCKS_REQUIRED(pool.cs)
+static void entryToJSON(const MempoolSnapshot& snapshot, UniValue& info, size_t pos)
 {
-    AssertLockHeld(pool.cs);
+    const MempoolSnapshot::Entry& e = snapshot.entries[pos];
 
     UniValue fees(UniValue::VOBJ);
-    fees.pushKV("base", ValueFromAmount(e.GetFee()));
-    fees.pushKV("modified", ValueFromAmount(e.GetModifiedFee()));
-    fees.pushKV("ancestor", ValueFromAmount(e.GetModFeesWithAncestors()));
-    fees.pushKV("descendant", ValueFromAmount(e.GetModFeesWithDescendants()));
+    fees.pushKV("base", ValueFromAmount(e.fee));
+    fees.pushKV("modified", ValueFromAmount(e.modified_fee));
+    fees.pushKV("ancestor", ValueFromAmount(e.mod_fees_with_ancestors));
+    fees.pushKV("descendant", ValueFromAmount(e.mod_fees_with_descendants));
     info.pushKV("fees", fees);
 
-    info.pushKV("vsize", (int)e.GetTxSize());
-    if (IsDeprecatedRPCEnabled("size")) info.pushKV("size", (int)e.GetTxSize());
-    info.pushKV("fee", ValueFromAmount(e.GetFee()));
-    info.pushKV("modifiedfee", ValueFromAmount(e.GetModifiedFee()));
-    info.pushKV("time", e.GetTime());
-    info.pushKV("height", (int)e.GetHeight());
-    info.pushKV("descendantcount", e.GetCountWithDescendants());
-    info.pushKV("descendantsize", e.GetSizeWithDescendants());
-    info.pushKV("descendantfees", e.GetModFeesWithDescendants());
-    info.pushKV("ancestorcount", e.GetCountWithAncestors());
-    info.pushKV("ancestorsize", e.GetSizeWithAncestors());
-    info.pushKV("ancestorfees", e.GetModFeesWithAncestors());
-    info.pushKV("wtxid", pool.vTxHashes[e.vTxHashesIdx].first.ToString());
-    const CTransaction& tx = e.GetTx();
+    info.pushKV("vsize", (int)e.vsize);
+    if (IsDeprecatedRPCEnabled("size")) info.pushKV("size", (int)e.vsize);
+    info.pushKV("fee", ValueFromAmount(e.fee));
+    info.pushKV("modifiedfee", ValueFromAmount(e.modified_fee));
+    info.pushKV("time", e.time);
+    info.pushKV("height", (int)e.height);
+    info.pushKV("descendantcount", e.count_with_descendants);
+    info.pushKV("descendantsize", e.size_with_descendants);
+    info.pushKV("descendantfees", e.mod_fees_with_descendants);
+    info.pushKV("ancestorcount", e.count_with_ancestors);
+    info.pushKV("ancestorsize", e.size_with_ancestors);
+    info.pushKV("ancestorfees", e.mod_fees_with_ancestors);
+    info.pushKV("wtxid", e.tx->GetWitnessHash().ToString());
+
     std::set<std::string> setDepends;
-    for (const CTxIn& txin : tx.vin)
+    for (size_t parent : e.parents)
     {
-        if (pool.exists(txin.prevout.hash))
-            setDepends.insert(txin.prevout.hash.ToString());
+        setDepends.insert(snapshot.entries[parent].tx->GetHash().ToString());
     }
 
     UniValue depends(UniValue::VARR);
@@ -454,36 +462,56 @@ static void entryToJSON(const CTxMemPool& pool, UniValue& info, const CTxMemPool
 
     info.pushKV("depends", depends);
 
+    std::set<uint256> setChildren;
+    for (size_t child : e.children) {
+        setChildren.insert(snapshot.entries[child].tx->GetHash());
+    }
+
     UniValue spent(UniValue::VARR);
-    const CTxMemPool::txiter& it = pool.mapTx.find(tx.GetHash());
-    const CTxMemPool::setEntries& setChildren = pool.GetMemPoolChildren(it);
-    for (CTxMemPool::txiter childiter : setChildren) {
-        spent.push_back(childiter->GetTx().GetHash().ToString());
+    for (const uint256& child : setChildren) {
+        spent.push_back(child.ToString());
     }
 
     info.pushKV("spentby", spent);
 
-    // Add opt-in RBF status
-    bool rbfStatus = false;
-    RBFTransactionState rbfState = IsRBFOptIn(tx, pool);
-    if (rbfState == RBFTransactionState::UNKNOWN) {
-        throw JSONRPCError(RPC_MISC_ERROR, "Transaction is not in mempool");
-    } else if (rbfState == RBFTransactionState::REPLACEABLE_BIP125) {
-        rbfStatus = true;
+    // Add opt-in RBF status, which can be inherited from in-mempool ancestors
+    bool rbfStatus = SignalsOptInRBF(*e.tx);
+    if (!rbfStatus) {
+        for (size_t ancestor : snapshot.GetAncestors(pos)) {
+            if (SignalsOptInRBF(*snapshot.entries[ancestor].tx)) {
+                rbfStatus = true;
+                break;
+            }
+        }
     }
 
     info.pushKV("bip125-replaceable", rbfStatus);
 }
 
+/** Transaction ids of snapshot entries in ascending order, as listed by RPCs */
+static std::map<uint256, size_t> SortByTxid(const MempoolSnapshot& snapshot, const std::vector<size_t>& positions)
+{
+    std::map<uint256, size_t> result;
+    for (size_t pos : positions) {
+        result.emplace(snapshot.entries[pos].tx->GetHash(), pos);
+    }
+    return result;
+}
+
+static size_t MaxMempoolSize()
+{
+    return gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+}
+
 UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose)
 {
+    const std::shared_ptr<const MempoolSnapshot> snapshot = pool.GetSnapshot(MaxMempoolSize());
     if (verbose) {
-        LOCK(pool.cs);
         UniValue o(UniValue::VOBJ);
-        for (const CTxMemPoolEntry& e : pool.mapTx) {
-            const uint256& hash = e.GetTx().GetHash();
+        for (size_t pos = 0; pos < snapshot->entries.size(); ++pos) {
+            const uint256& hash = snapshot->entries[pos].tx->GetHash();
             UniValue info(UniValue::VOBJ);
-            entryToJSON(pool, info, e);
+            entryToJSON(*snapshot, info, pos);
             // Mempool has unique entries so there is no advantage in using
             // UniValue::pushKV, which checks if the key already exists in O(N).
             // UniValue::__pushKV is used instead which currently is O(1).
@@ -491,12 +519,9 @@ UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose)
         }
         return o;
     } else {
-        std::vector<uint256> vtxid;
-        pool.queryHashes(vtxid);
-
         UniValue a(UniValue::VARR);
-        for (const uint256& hash : vtxid)
-            a.push_back(hash.ToString());
+        for (const MempoolSnapshot::Entry& e : snapshot->entries)
+            a.push_back(e.tx->GetHash().ToString());
 
         return a;
     }
@@ -575,33 +600,28 @@ static UniValue getmempoolancestors(const JSONRPCRequest& request)
 
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
-    LOCK(mempool.cs);
+    const std::shared_ptr<const MempoolSnapshot> snapshot = ::mempool.GetSnapshot(MaxMempoolSize());
 
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
+    const ptrdiff_t pos = snapshot->Find(hash);
+    if (pos < 0) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
     }
 
-    CTxMemPool::setEntries setAncestors;
-    uint64_t noLimit = std::numeric_limits<uint64_t>::max();
-    std::string dummy;
-    mempool.CalculateMemPoolAncestors(*it, setAncestors, noLimit, noLimit, noLimit, noLimit, dummy, false);
+    const std::map<uint256, size_t> ancestors = SortByTxid(*snapshot, snapshot->GetAncestors(pos));
 
     if (!fVerbose) {
         UniValue o(UniValue::VARR);
-        for (CTxMemPool::txiter ancestorIt : setAncestors) {
-            o.push_back(ancestorIt->GetTx().GetHash().ToString());
+        for (const auto& ancestor : ancestors) {
+            o.push_back(ancestor.first.ToString());
         }
 
         return o;
     } else {
         UniValue o(UniValue::VOBJ);
-        for (CTxMemPool::txiter ancestorIt : setAncestors) {
-            const CTxMemPoolEntry &e = *ancestorIt;
-            const uint256& _hash = e.GetTx().GetHash();
+        for (const auto& ancestor : ancestors) {
             UniValue info(UniValue::VOBJ);
-            entryToJSON(::mempool, info, e);
-            o.pushKV(_hash.ToString(), info);
+            entryToJSON(*snapshot, info, ancestor.second);
+            o.pushKV(ancestor.first.ToString(), info);
         }
         return o;
     }
@@ -645,33 +665,28 @@ static UniValue getmempooldescendants(const JSONRPCRequest& request)
 
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
-    LOCK(mempool.cs);
+    const std::shared_ptr<const MempoolSnapshot> snapshot = ::mempool.GetSnapshot(MaxMempoolSize());
 
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
+    const ptrdiff_t pos = snapshot->Find(hash);
+    if (pos < 0) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
     }
 
-    CTxMemPool::setEntries setDescendants;
-    mempool.CalculateDescendants(it, setDescendants);
-    // CTxMemPool::CalculateDescendants will include the given tx
-    setDescendants.erase(it);
+    const std::map<uint256, size_t> descendants = SortByTxid(*snapshot, snapshot->GetDescendants(pos));
 
     if (!fVerbose) {
         UniValue o(UniValue::VARR);
-        for (CTxMemPool::txiter descendantIt : setDescendants) {
-            o.push_back(descendantIt->GetTx().GetHash().ToString());
+        for (const auto& descendant : descendants) {
+            o.push_back(descendant.first.ToString());
         }
 
         return o;
     } else {
         UniValue o(UniValue::VOBJ);
-        for (CTxMemPool::txiter descendantIt : setDescendants) {
-            const CTxMemPoolEntry &e = *descendantIt;
-            const uint256& _hash = e.GetTx().GetHash();
+        for (const auto& descendant : descendants) {
             UniValue info(UniValue::VOBJ);
-            entryToJSON(::mempool, info, e);
-            o.pushKV(_hash.ToString(), info);
+            entryToJSON(*snapshot, info, descendant.second);
+            o.pushKV(descendant.first.ToString(), info);
         }
         return o;
     }
@@ -700,16 +715,15 @@ static UniValue getmempoolentry(const JSONRPCRequest& request)
 
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
-    LOCK(mempool.cs);
+    const std::shared_ptr<const MempoolSnapshot> snapshot = ::mempool.GetSnapshot(MaxMempoolSize());
 
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
+    const ptrdiff_t pos = snapshot->Find(hash);
+    if (pos < 0) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
     }
 
-    const CTxMemPoolEntry &e = *it;
     UniValue info(UniValue::VOBJ);
-    entryToJSON(::mempool, info, e);
+    entryToJSON(*snapshot, info, pos);
     return info;
 }
 
@@ -940,77 +954,6 @@ static UniValue getblock(const JSONRPCRequest& request)
     return blockToJSON(block, tip, pblockindex, verbosity >= 2);
 }
 
-struct CCoinsStats
-{
-    int nHeight;
-    uint256 hashBlock;
-    uint64_t nTransactions;
-    uint64_t nTransactionOutputs;
-    uint64_t nBogoSize;
-    uint256 hashSerialized;
-    uint64_t nDiskSize;
-    CAmount nTotalAmount;
-
-    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
-};
-
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
-{
-    assert(!outputs.empty());
-    ss << hash;
-    ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase ? 1u : 0u);
-    stats.nTransactions++;
-    for (const auto& output : outputs) {
-        ss << VARINT(output.first + 1);
-        ss << output.second.out.scriptPubKey;
-        ss << VARINT(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
-        stats.nTransactionOutputs++;
-        stats.nTotalAmount += output.second.out.nValue;
-        stats.nBogoSize += 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
-                           2 /* scriptPubKey len */ + output.second.out.scriptPubKey.size() /* scriptPubKey */;
-    }
-    ss << VARINT(0u);
-}
-
-//! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
-{
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-    assert(pcursor);
-
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = pcursor->GetBestBlock();
-    {
-        LOCK(cs_main);
-        stats.nHeight = LookupBlockIndex(stats.hashBlock)->nHeight;
-    }
-    ss << stats.hashBlock;
-    uint256 prevkey;
-    std::map<uint32_t, Coin> outputs;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        COutPoint key;
-        Coin coin;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
-                outputs.clear();
-            }
-            prevkey = key.hash;
-            outputs[key.n] = std::move(coin);
-        } else {
-            return error("%s: unable to read value", __func__);
-        }
-        pcursor->Next();
-    }
-    if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
-    }
-    stats.hashSerialized = ss.GetHash();
-    stats.nDiskSize = view->EstimateSize();
-    return true;
-}
-
 static UniValue pruneblockchain(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -1071,26 +1014,30 @@ static UniValue pruneblockchain(const JSONRPCRequest& request)
 
 static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 1)
         throw std::runtime_error(
             RPCHelpMan{"gettxoutsetinfo",
                 "\nReturns statistics about the unspent transaction output set.\n"
-                "Note this call may take some time.\n",
-                {},
+                "Note this call may take some time, unless the statistics after a given block are looked up in the coin statistics index.\n",
+                {
+                    {"hash_or_height", RPCArg::Type::NUM, RPCArg::Optional::OMITTED, "Look up the statistics after this block in the coin statistics index (requires -coinstatsindex)", "", {"", "string or numeric"}},
+                },
                 RPCResult{
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) The hash of the block at the tip of the chain\n"
-            "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs\n"
+            "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs (not available with hash_or_height)\n"
             "  \"txouts\": n,            (numeric) The number of unspent transaction outputs\n"
             "  \"bogosize\": n,          (numeric) A meaningless metric for UTXO set size\n"
-            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
-            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash (not available with hash_or_height)\n"
+            "  \"muhash\": \"hash\",     (string) The order-independent MuHash of the set (only available with hash_or_height)\n"
+            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk (not available with hash_or_height)\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
                 },
                 RPCExamples{
                     HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "1000")
             + HelpExampleRpc("gettxoutsetinfo", "")
                 },
             }.ToString());
@@ -1098,8 +1045,48 @@ static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     UniValue ret(UniValue::VOBJ);
 
     CCoinsStats stats;
+    if (!request.params[0].isNull()) {
+        if (!g_coin_stats_index) {
+            throw JSONRPCError(RPC_MISC_ERROR, "Looking up statistics by block requires -coinstatsindex");
+        }
+        g_coin_stats_index->BlockUntilSyncedToCurrentChain();
+
+        const CBlockIndex* pindex;
+        {
+            LOCK(cs_main);
+            if (request.params[0].isNum()) {
+                const int height = request.params[0].get_int();
+                const int current_tip = ::ChainActive().Height();
+                if (height < 0) {
+                    throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d is negative", height));
+                }
+                if (height > current_tip) {
+                    throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d after current tip %d", height, current_tip));
+                }
+                pindex = ::ChainActive()[height];
+            } else {
+                const uint256 hash(ParseHashV(request.params[0], "hash_or_height"));
+                pindex = LookupBlockIndex(hash);
+                if (!pindex) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+                }
+            }
+        }
+
+        if (!g_coin_stats_index->LookUpStats(pindex, stats)) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to find statistics for the block; the coin statistics index may still be syncing");
+        }
+        ret.pushKV("height", (int64_t)stats.nHeight);
+        ret.pushKV("bestblock", stats.hashBlock.GetHex());
+        ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
+        ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
+        ret.pushKV("muhash", stats.hashMuHash.GetHex());
+        ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
+        return ret;
+    }
+
     ::ChainstateActive().ForceFlushStateToDisk();
-    if (GetUTXOStats(pcoinsdbview.get(), stats)) {
+    if (GetUTXOStats(pcoinsdbview.get(), stats, std::min(GetNumCores(), MAX_UTXO_STATS_THREADS))) {
         ret.pushKV("height", (int64_t)stats.nHeight);
         ret.pushKV("bestblock", stats.hashBlock.GetHex());
         ret.pushKV("transactions", (int64_t)stats.nTransactions);
@@ -1523,16 +1510,16 @@ static UniValue getchaintips(const JSONRPCRequest& request)
 
 UniValue MempoolInfoToJSON(const CTxMemPool& pool)
 {
-    // Make sure this call is atomic in the pool.
-    LOCK(pool.cs);
+    // The snapshot is consistent, like a call holding the pool lock.
+    size_t maxmempool = MaxMempoolSize();
+    const std::shared_ptr<const MempoolSnapshot> snapshot = pool.GetSnapshot(maxmempool);
     UniValue ret(UniValue::VOBJ);
-    ret.pushKV("loaded", pool.IsLoaded());
-    ret.pushKV("size", (int64_t)pool.size());
-    ret.pushKV("bytes", (int64_t)pool.GetTotalTxSize());
-    ret.pushKV("usage", (int64_t)pool.DynamicMemoryUsage());
-    size_t maxmempool = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    ret.pushKV("loaded", snapshot->loaded);
+    ret.pushKV("size", (int64_t)snapshot->entries.size());
+    ret.pushKV("bytes", (int64_t)snapshot->total_tx_size);
+    ret.pushKV("usage", (int64_t)snapshot->dynamic_usage);
     ret.pushKV("maxmempool", (int64_t) maxmempool);
-    ret.pushKV("mempoolminfee", ValueFromAmount(std::max(pool.GetMinFee(maxmempool), ::minRelayTxFee).GetFeePerK()));
+    ret.pushKV("mempoolminfee", ValueFromAmount(std::max(snapshot->min_fee, ::minRelayTxFee).GetFeePerK()));
     ret.pushKV("minrelaytxfee", ValueFromAmount(::minRelayTxFee.GetFeePerK()));
 
     return ret;
@@ -1565,6 +1552,170 @@ static UniValue getmempoolinfo(const JSONRPCRequest& request)
     return MempoolInfoToJSON(::mempool);
 }
 
+static UniValue getdbparams(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            RPCHelpMan{"getdbparams",
+                "\nReturns the LevelDB parameters of the open databases, which can be tuned with -dbparam.\n",
+                {},
+                RPCResult{
+            "[\n"
+            "  {\n"
+            "    \"name\": \"xxxx\",             (string) The name of the database, as used by -dbparam\n"
+            "    \"path\": \"xxxx\",             (string) The directory of the database\n"
+            "    \"in_memory\": true|false,     (boolean) Whether the database is only kept in memory\n"
+            "    \"cache_size\": xxxxx,         (numeric) The cache size in bytes the database was opened with\n"
+            "    \"block_size\": xxxxx,         (numeric) The size of the data blocks in bytes\n"
+            "    \"bloom_bits\": xxxxx,         (numeric) The bits per key of the bloom filters (0 if there are none)\n"
+            "    \"compression\": true|false,   (boolean) Whether compression is requested\n"
+            "    \"write_buffer_size\": xxxxx,  (numeric) The size of the write buffer in bytes\n"
+            "    \"max_file_size\": xxxxx,      (numeric) The size in bytes after which a new table file is started\n"
+            "    \"max_open_files\": xxxxx      (numeric) The maximum number of files kept open\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getdbparams", "")
+            + HelpExampleRpc("getdbparams", "")
+                },
+            }.ToString());
+
+    UniValue ret(UniValue::VARR);
+    for (const DBInfo& db : ListDBs()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("name", db.name);
+        obj.pushKV("path", db.path.string());
+        obj.pushKV("in_memory", db.in_memory);
+        obj.pushKV("cache_size", (uint64_t)db.cache_size);
+        obj.pushKV("block_size", (uint64_t)db.params.block_size);
+        obj.pushKV("bloom_bits", db.params.bloom_bits);
+        obj.pushKV("compression", db.params.compression);
+        obj.pushKV("write_buffer_size", (uint64_t)db.write_buffer_size);
+        obj.pushKV("max_file_size", (uint64_t)db.params.max_file_size);
+        obj.pushKV("max_open_files", db.max_open_files);
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+static UniValue LatencyToJSON(const std::vector<uint64_t>& buckets)
+{
+    // Leave out the empty buckets at the end.
+    size_t size = buckets.size();
+    while (size > 0 && buckets[size - 1] == 0) --size;
+    UniValue ret(UniValue::VARR);
+    for (size_t i = 0; i < size; ++i) {
+        ret.push_back(buckets[i]);
+    }
+    return ret;
+}
+
+static UniValue getdbstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            RPCHelpMan{"getdbstats",
+                "\nReturns LevelDB statistics and operation counters of the open databases.\n"
+                "\nLatency histograms are arrays whose element i counts the operations that took less than 2^i\n"
+                "microseconds (and at least 2^(i-1)); empty buckets at the end are left out.\n",
+                {
+                    {"verbose", RPCArg::Type::BOOL, /* default */ "false", "Include the key ranges of all table files"},
+                },
+                RPCResult{
+            "[\n"
+            "  {\n"
+            "    \"name\": \"xxxx\",              (string) The name of the database\n"
+            "    \"path\": \"xxxx\",              (string) The directory of the database\n"
+            "    \"approximate_size\": xxxxx,     (numeric) The approximate size of the table files in bytes\n"
+            "    \"memory_usage\": xxxxx,         (numeric) The approximate memory usage of the write buffers and block cache in bytes\n"
+            "    \"files_per_level\": [n, ...],   (array) The number of table files at each level\n"
+            "    \"compaction_stats\": \"xxxx\",  (string) The compaction statistics per level, as reported by LevelDB\n"
+            "    \"sstables\": \"xxxx\",          (string) The key ranges of all table files (only if verbose)\n"
+            "    \"block_cache\": {\n"
+            "      \"usage\": xxxxx,              (numeric) The size of the cached blocks in bytes\n"
+            "      \"capacity\": xxxxx,           (numeric) The capacity of the block cache in bytes\n"
+            "      \"hits\": xxxxx,               (numeric) The number of lookups that found the block in the cache\n"
+            "      \"misses\": xxxxx              (numeric) The number of lookups that had to read the block from disk\n"
+            "    },\n"
+            "    \"reads\": {\n"
+            "      \"count\": xxxxx,              (numeric) The number of reads\n"
+            "      \"not_found\": xxxxx,          (numeric) The number of reads of keys that did not exist\n"
+            "      \"bytes\": xxxxx,              (numeric) The number of value bytes read\n"
+            "      \"latency\": [n, ...]          (array) The latency histogram of the reads\n"
+            "    },\n"
+            "    \"exists\": {\n"
+            "      \"count\": xxxxx,              (numeric) The number of existence checks\n"
+            "      \"not_found\": xxxxx,          (numeric) The number of checks of keys that did not exist\n"
+            "      \"latency\": [n, ...]          (array) The latency histogram of the checks\n"
+            "    },\n"
+            "    \"batches\": {\n"
+            "      \"count\": xxxxx,              (numeric) The number of batches written\n"
+            "      \"synced\": xxxxx,             (numeric) The number of batches written synchronously\n"
+            "      \"bytes\": xxxxx,              (numeric) The estimated number of bytes written\n"
+            "      \"latency\": [n, ...]          (array) The latency histogram of the batch writes\n"
+            "    }\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+                },
+            }.ToString());
+
+    const bool verbose = !request.params[0].isNull() && request.params[0].get_bool();
+
+    UniValue ret(UniValue::VARR);
+    for (const DBStats& db : GetDBStats(verbose)) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("name", db.name);
+        obj.pushKV("path", db.path.string());
+        obj.pushKV("approximate_size", db.approximate_size);
+        obj.pushKV("memory_usage", db.memory_usage);
+        UniValue files(UniValue::VARR);
+        for (int n : db.files_per_level) {
+            files.push_back(n);
+        }
+        obj.pushKV("files_per_level", files);
+        obj.pushKV("compaction_stats", db.compaction_stats);
+        if (verbose) {
+            obj.pushKV("sstables", db.sstables);
+        }
+
+        UniValue cache(UniValue::VOBJ);
+        cache.pushKV("usage", db.block_cache_usage);
+        cache.pushKV("capacity", db.block_cache_capacity);
+        cache.pushKV("hits", db.block_cache_hits);
+        cache.pushKV("misses", db.block_cache_misses);
+        obj.pushKV("block_cache", cache);
+
+        UniValue reads(UniValue::VOBJ);
+        reads.pushKV("count", db.reads);
+        reads.pushKV("not_found", db.reads_not_found);
+        reads.pushKV("bytes", db.read_bytes);
+        reads.pushKV("latency", LatencyToJSON(db.read_latency));
+        obj.pushKV("reads", reads);
+
+        UniValue exists(UniValue::VOBJ);
+        exists.pushKV("count", db.exists);
+        exists.pushKV("not_found", db.exists_not_found);
+        exists.pushKV("latency", LatencyToJSON(db.exists_latency));
+        obj.pushKV("exists", exists);
+
+        UniValue batches(UniValue::VOBJ);
+        batches.pushKV("count", db.batches);
+        batches.pushKV("synced", db.batches_synced);
+        batches.pushKV("bytes", db.batch_bytes);
+        batches.pushKV("latency", LatencyToJSON(db.batch_latency));
+        obj.pushKV("batches", batches);
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 static UniValue preciousblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -2101,33 +2252,111 @@ static UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
-//! Search for a given set of pubkey scripts
-bool FindScriptPubKey(std::atomic<int>& scan_progress, const std::atomic<bool>& should_abort, int64_t& count, CCoinsViewCursor* cursor, const std::set<CScript>& needles, std::map<COutPoint, Coin>& out_results) {
+//! Number of ranges the UTXO set is searched in; the first byte of the transaction hash selects the range.
+static const int SCAN_PARTITIONS = 256;
+
+ScriptPubKeyMatcher::ScriptHasher::ScriptHasher() :
+    m_k0(GetRand(std::numeric_limits<uint64_t>::max())),
+    m_k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+uint64_t ScriptPubKeyMatcher::ScriptHasher::Hash(const CScript& script) const
+{
+    return CSipHasher(m_k0, m_k1).Write(script.data(), script.size()).Finalize();
+}
+
+ScriptPubKeyMatcher::ScriptPubKeyMatcher(const std::vector<CScript>& scripts) :
+    m_scripts(scripts.size(), m_hasher)
+{
+    // About 16 bits per script, with two bits set per script, let one in 70
+    // coins that do not match through the filter.
+    size_t bits = 64;
+    while (bits < 16 * scripts.size()) bits *= 2;
+    m_filter.assign(bits / 64, 0);
+    m_filter_mask = bits - 1;
+    for (const CScript& script : scripts) {
+        const uint64_t hash = m_hasher.Hash(script);
+        const uint64_t bit1 = hash & m_filter_mask, bit2 = (hash >> 32) & m_filter_mask;
+        m_filter[bit1 >> 6] |= uint64_t{1} << (bit1 & 63);
+        m_filter[bit2 >> 6] |= uint64_t{1} << (bit2 & 63);
+        m_scripts.insert(script);
+    }
+}
+
+bool ScriptPubKeyMatcher::MaybeContains(uint64_t hash) const
+{
+    const uint64_t bit1 = hash & m_filter_mask, bit2 = (hash >> 32) & m_filter_mask;
+    return (m_filter[bit1 >> 6] >> (bit1 & 63)) & (m_filter[bit2 >> 6] >> (bit2 & 63)) & 1;
+}
+
+bool ScriptPubKeyMatcher::Contains(const CScript& script) const
+{
+    return MaybeContains(m_hasher.Hash(script)) && m_scripts.count(script);
+}
+
+bool FindScriptPubKey(std::atomic<int>& scan_progress, const std::atomic<bool>& should_abort, int64_t& count, CCoinsViewDB& view, const ScriptPubKeyMatcher& needles, std::map<COutPoint, Coin>& out_results, int n_threads)
+{
+    n_threads = std::max(1, std::min(n_threads, SCAN_PARTITIONS));
     scan_progress = 0;
     count = 0;
-    while (cursor->Valid()) {
-        COutPoint key;
-        Coin coin;
-        if (!cursor->GetKey(key) || !cursor->GetValue(coin)) return false;
-        if (++count % 8192 == 0) {
-            boost::this_thread::interruption_point();
-            if (should_abort) {
-                // allow to abort the scan via the abort reference
-                return false;
+
+    std::vector<uint256> starts(SCAN_PARTITIONS);
+    for (int i = 0; i < SCAN_PARTITIONS; ++i) {
+        *starts[i].begin() = i;
+    }
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors = view.Cursors(starts);
+
+    std::atomic<int> next_partition{0};
+    std::atomic<int> done_partitions{0};
+    std::atomic<int64_t> total_count{0};
+    std::atomic<bool> failed{false};
+    std::mutex results_mutex;
+
+    auto worker = [&]() {
+        util::ThreadRename("scantxoutset");
+        std::map<COutPoint, Coin> results;
+        int64_t n = 0;
+        int i;
+        while (!failed && (i = next_partition++) < SCAN_PARTITIONS) {
+            // allow to abort the scan via the abort reference before each range
+            // and every 8192 items within it
+            if (should_abort || ShutdownRequested()) {
+                failed = true;
+                break;
             }
+            CCoinsViewCursor& cursor = *cursors[i];
+            for (; cursor.Valid(); cursor.Next()) {
+                COutPoint key;
+                Coin coin;
+                if (!cursor.GetKey(key) || !cursor.GetValue(coin)) {
+                    failed = true;
+                    break;
+                }
+                if (*key.hash.begin() != i) break;
+                if (++n % 8192 == 0 && (should_abort || ShutdownRequested())) {
+                    failed = true;
+                    break;
+                }
+                if (needles.Contains(coin.out.scriptPubKey)) {
+                    results.emplace(key, std::move(coin));
+                }
+            }
+            cursors[i].reset();
+            scan_progress = ++done_partitions * 100 / SCAN_PARTITIONS;
         }
-        if (count % 256 == 0) {
-            // update progress reference every 256 item
-            uint32_t high = 0x100 * *key.hash.begin() + *(key.hash.begin() + 1);
-            scan_progress = (int)(high * 100.0 / 65536.0 + 0.5);
-        }
-        if (needles.count(coin.out.scriptPubKey)) {
-            out_results.emplace(key, coin);
-        }
-        cursor->Next();
+        total_count += n;
+        std::lock_guard<std::mutex> lock(results_mutex);
+        out_results.insert(results.begin(), results.end());
+    };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < n_threads; ++i) {
+        threads.emplace_back(worker);
     }
-    scan_progress = 100;
-    return true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    count = total_count;
+    return !failed;
 }
 
 /** RAII object to prevent concurrency issue when scanning the txout set */
@@ -2241,7 +2470,7 @@ UniValue scantxoutset(const JSONRPCRequest& request)
         if (!reserver.reserve()) {
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Scan already in progress, use action \"abort\" or \"status\"");
         }
-        std::set<CScript> needles;
+        std::vector<CScript> needles;
         std::map<CScript, std::string> descriptors;
         CAmount total_in = 0;
 
@@ -2279,7 +2508,7 @@ UniValue scantxoutset(const JSONRPCRequest& request)
                 }
                 for (const auto& script : scripts) {
                     std::string inferred = InferDescriptor(script, provider)->ToString();
-                    needles.emplace(script);
+                    needles.push_back(script);
                     descriptors.emplace(std::move(script), std::move(inferred));
                 }
             }
@@ -2292,14 +2521,14 @@ UniValue scantxoutset(const JSONRPCRequest& request)
         g_should_abort_scan = false;
         g_scan_progress = 0;
         int64_t count = 0;
-        std::unique_ptr<CCoinsViewCursor> pcursor;
+        CCoinsViewDB* view;
         {
             LOCK(cs_main);
             ::ChainstateActive().ForceFlushStateToDisk();
-            pcursor = std::unique_ptr<CCoinsViewCursor>(pcoinsdbview->Cursor());
-            assert(pcursor);
+            view = pcoinsdbview.get();
         }
-        bool res = FindScriptPubKey(g_scan_progress, g_should_abort_scan, count, pcursor.get(), needles, coins);
+        bool res = FindScriptPubKey(g_scan_progress, g_should_abort_scan, count, *view, ScriptPubKeyMatcher(needles), coins,
+                                    std::min(GetNumCores(), MAX_SCAN_THREADS));
         result.pushKV("success", res);
         result.pushKV("searched_items", count);
 
@@ -2420,6 +2649,8 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockhash",           &getblockhash,           {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"} },
     { "blockchain",         "getchaintips",           &getchaintips,           {} },
+    { "blockchain",         "getdbparams",            &getdbparams,            {} },
+    { "blockchain",         "getdbstats",             &getdbstats,             {"verbose"} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          {} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
@@ -2427,7 +2658,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"hash_or_height"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
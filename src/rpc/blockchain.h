@@ -6,15 +6,21 @@
 #define BITCOIN_RPC_BLOCKCHAIN_H
 
 #include <amount.h>
+#include <coins.h>
+#include <script/script.h>
 #include <sync.h>
 
+#include <atomic>
+#include <map>
 #include <stdint.h>
+#include <unordered_set>
 #include <vector>
 
 extern RecursiveMutex cs_main;
 
 class CBlock;
 class CBlockIndex;
+class CCoinsViewDB;
 class CTxMemPool;
 class UniValue;
 
@@ -46,4 +52,50 @@ UniValue blockheaderToJSON(const CBlockIndex* tip, const CBlockIndex* blockindex
 /** Used by getblockstats to get feerates at different percentiles by weight  */
 void CalculatePercentilesByWeight(CAmount result[NUM_GETBLOCKSTATS_PERCENTILES], std::vector<std::pair<CAmount, int64_t>>& scores, int64_t total_weight);
 
+/**
+ * A set of pubkey scripts to search the UTXO set for. Scans look up every
+ * coin in it, and almost none of them match, so a bitmap indexed by bits of
+ * the script hashes (a bloom filter) rejects most coins before the hash set
+ * of the scripts is consulted.
+ */
+class ScriptPubKeyMatcher
+{
+private:
+    class ScriptHasher
+    {
+    private:
+        const uint64_t m_k0, m_k1;
+
+    public:
+        ScriptHasher();
+        uint64_t Hash(const CScript& script) const;
+        size_t operator()(const CScript& script) const { return Hash(script); }
+    };
+
+    ScriptHasher m_hasher;
+    std::vector<uint64_t> m_filter;
+    uint64_t m_filter_mask{0};
+    std::unordered_set<CScript, ScriptHasher> m_scripts;
+
+    bool MaybeContains(uint64_t hash) const;
+
+public:
+    explicit ScriptPubKeyMatcher(const std::vector<CScript>& scripts);
+
+    bool Contains(const CScript& script) const;
+    size_t size() const { return m_scripts.size(); }
+};
+
+/** Maximum number of threads to scan the UTXO set for pubkey scripts with */
+static const int MAX_SCAN_THREADS = 16;
+
+/**
+ * Search the UTXO set for the coins whose pubkey script is in needles.
+ *
+ * The set is split into ranges of transaction hashes, which are scanned on up
+ * to n_threads threads. scan_progress reports the share of scanned ranges in
+ * percent, and setting should_abort stops all threads at the next check.
+ */
+bool FindScriptPubKey(std::atomic<int>& scan_progress, const std::atomic<bool>& should_abort, int64_t& count, CCoinsViewDB& view, const ScriptPubKeyMatcher& needles, std::map<COutPoint, Coin>& out_results, int n_threads = 1);
+
 #endif
@@ -470,6 +470,10 @@ static UniValue getnetworkinfo(const JSONRPCRequest& request)
             "  ],\n"
             "  \"relayfee\": x.xxxxxxxx,                (numeric) minimum relay fee for transactions in " + CURRENCY_UNIT + "/kB\n"
             "  \"incrementalfee\": x.xxxxxxxx,          (numeric) minimum fee increment for mempool limiting or BIP 125 replacement in " + CURRENCY_UNIT + "/kB\n"
+            "  \"recvbufferpool\": {                    (json object) buffers kept for the bodies of large received messages\n"
+            "    \"buffers\": xxxxx,                    (numeric) the number of buffers in the pool\n"
+            "    \"bytes\": xxxxx                       (numeric) the memory held by the buffers in the pool\n"
+            "  },\n"
             "  \"localaddresses\": [                    (array) list of local addresses\n"
             "  {\n"
             "    \"address\": \"xxxx\",                 (string) network address\n"
@@ -503,6 +507,10 @@ static UniValue getnetworkinfo(const JSONRPCRequest& request)
     obj.pushKV("networks",      GetNetworksInfo());
     obj.pushKV("relayfee",      ValueFromAmount(::minRelayTxFee.GetFeePerK()));
     obj.pushKV("incrementalfee", ValueFromAmount(::incrementalRelayFee.GetFeePerK()));
+    UniValue recvBufferPool(UniValue::VOBJ);
+    recvBufferPool.pushKV("buffers", (uint64_t)g_recv_buffer_pool.GetPooledBuffers());
+    recvBufferPool.pushKV("bytes", (uint64_t)g_recv_buffer_pool.GetPooledBytes());
+    obj.pushKV("recvbufferpool", recvBufferPool);
     UniValue localAddresses(UniValue::VARR);
     {
         LOCK(cs_mapLocalHost);
@@ -10,8 +10,11 @@
 #include <crypto/sha256.h>
 #include <pubkey.h>
 #include <script/script.h>
+#include <streams.h>
 #include <uint256.h>
 
+#include <algorithm>
+
 typedef std::vector<unsigned char> valtype;
 
 namespace {
@@ -1182,6 +1185,34 @@ public:
     }
 };
 
+/** Writer stream that feeds the serialized data into an existing hasher. */
+class CHash256Writer
+{
+private:
+    CHash256& ctx;
+
+public:
+    explicit CHash256Writer(CHash256& ctxIn) : ctx(ctxIn) {}
+
+    int GetType() const { return SER_GETHASH; }
+    int GetVersion() const { return 0; }
+
+    void write(const char* pch, size_t size)
+    {
+        ctx.Write((const unsigned char*)pch, size);
+    }
+
+    template <typename T>
+    CHash256Writer& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj);
+        return *this;
+    }
+};
+
+/** Size of a serialized input with an empty script: prevout, script length and nSequence. */
+static constexpr size_t LEGACY_EMPTY_INPUT_SIZE = 36 + 1 + 4;
+
 template <class T>
 uint256 GetPrevoutHash(const T& txTo)
 {
@@ -1224,6 +1255,28 @@ PrecomputedTransactionData::PrecomputedTransactionData(const T& txTo)
         hashOutputs = GetOutputsHash(txTo);
         ready = true;
     }
+
+    // Inputs with a witness are never signed with a legacy signature hash,
+    // so the legacy cache is only needed if some input has none.
+    const bool has_legacy_input = std::any_of(txTo.vin.begin(), txTo.vin.end(), [](const CTxIn& txin) { return txin.scriptWitness.IsNull(); });
+    if (has_legacy_input) {
+        CVectorWriter suffix(SER_GETHASH, 0, legacySuffix, 0);
+        for (const auto& txin : txTo.vin) {
+            suffix << txin.prevout << CScript() << txin.nSequence;
+        }
+        suffix << txTo.vout << txTo.nLockTime;
+
+        CHash256 ctx;
+        CHash256Writer prefix(ctx);
+        prefix << txTo.nVersion;
+        WriteCompactSize(prefix, txTo.vin.size());
+        legacyMidstates.reserve(txTo.vin.size());
+        for (size_t i = 0; i < txTo.vin.size(); i++) {
+            legacyMidstates.push_back(ctx);
+            ctx.Write(legacySuffix.data() + i * LEGACY_EMPTY_INPUT_SIZE, LEGACY_EMPTY_INPUT_SIZE);
+        }
+        legacyReady = true;
+    }
 }
 
 // explicit instantiation
@@ -1294,6 +1347,20 @@ uint256 SignatureHash(const CScript& scriptCode, const T& txTo, unsigned int nIn
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer<T> txTmp(txTo, scriptCode, nIn, nHashType);
 
+    // For SIGHASH_ALL, resume from the cached state right before input nIn,
+    // and append the (cached) serialization of everything after it.
+    if (cache && cache->legacyReady && !(nHashType & SIGHASH_ANYONECANPAY) && (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE) {
+        CHash256 ctx = cache->legacyMidstates[nIn];
+        CHash256Writer ss(ctx);
+        txTmp.SerializeInput(ss, nIn);
+        const size_t nSuffixStart = (nIn + 1) * LEGACY_EMPTY_INPUT_SIZE;
+        ctx.Write(cache->legacySuffix.data() + nSuffixStart, cache->legacySuffix.size() - nSuffixStart);
+        ss << nHashType;
+        uint256 result;
+        ctx.Finalize(result.begin());
+        return result;
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << nHashType;
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_SCRIPT_INTERPRETER_H
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
+#include <hash.h>
 #include <script/script_error.h>
 #include <primitives/transaction.h>
 
@@ -124,6 +125,16 @@ struct PrecomputedTransactionData
     uint256 hashPrevouts, hashSequence, hashOutputs;
     bool ready = false;
 
+    /**
+     * Cache for legacy SIGHASH_ALL signature hashes. The serialization only
+     * differs per input in the scriptCode of the input being signed, so we
+     * keep the hasher state right before every input, and the serialization
+     * of all inputs with empty scripts followed by the outputs and nLockTime.
+     */
+    std::vector<CHash256> legacyMidstates;
+    std::vector<unsigned char> legacySuffix;
+    bool legacyReady = false;
+
     template <class T>
     explicit PrecomputedTransactionData(const T& tx);
 };
@@ -0,0 +1,202 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <algorithm>
+#include <new>
+#include <vector>
+
+/**
+ * A memory resource that hands out small blocks of memory from large chunks,
+ * for node based containers that hold many elements of the same size.
+ *
+ * Block sizes are rounded up to a multiple of ALIGN_BYTES. Freed blocks are
+ * kept in a free list per block size, and are reused for the next allocation
+ * of that size. Blocks larger than MAX_BLOCK_SIZE_BYTES, or with stricter
+ * alignment than ALIGN_BYTES, are passed on to ::operator new.
+ *
+ * Compared to allocating every node with malloc, this saves the per-block
+ * overhead of malloc, keeps nodes that are allocated together close in memory,
+ * and makes memory usage exactly known. Chunks are only given back when the
+ * resource is destroyed; until then, freed blocks are reused before a new
+ * chunk is allocated.
+ */
+template <size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+class PoolResource
+{
+    static_assert(ALIGN_BYTES > 0 && (ALIGN_BYTES & (ALIGN_BYTES - 1)) == 0, "ALIGN_BYTES must be a power of two");
+    static_assert(ALIGN_BYTES >= sizeof(void*), "Blocks must be able to hold a free list pointer");
+    static_assert(ALIGN_BYTES <= alignof(max_align_t), "Chunks are only aligned to max_align_t");
+
+    //! A freed block, linking to the next freed block of the same size.
+    struct ListNode {
+        ListNode* next;
+        explicit ListNode(ListNode* nextIn) : next(nextIn) {}
+    };
+
+    //! Number of free lists; list n holds blocks of n * ALIGN_BYTES.
+    static const size_t NUM_FREE_LISTS = (MAX_BLOCK_SIZE_BYTES + ALIGN_BYTES - 1) / ALIGN_BYTES + 1;
+
+    const size_t nChunkSizeBytes;
+    std::vector<void*> vChunks;
+    ListNode* freeLists[NUM_FREE_LISTS];
+
+    //! The part of the newest chunk that has not been handed out yet.
+    char* pAvailableBegin = nullptr;
+    char* pAvailableEnd = nullptr;
+
+    //! Total size of the blocks from the chunks that are currently handed out.
+    size_t nAllocatedBytes = 0;
+
+    static size_t NumAlignments(size_t bytes)
+    {
+        return std::max<size_t>(1, (bytes + ALIGN_BYTES - 1) / ALIGN_BYTES);
+    }
+
+    static bool IsFreeListUsable(size_t bytes, size_t alignment)
+    {
+        return alignment <= ALIGN_BYTES && bytes <= MAX_BLOCK_SIZE_BYTES;
+    }
+
+    void PushFree(void* p, size_t nAlignments)
+    {
+        freeLists[nAlignments] = new (p) ListNode(freeLists[nAlignments]);
+    }
+
+    void AllocateChunk()
+    {
+        // Don't waste the remainder of the current chunk; as it is a multiple
+        // of ALIGN_BYTES, it can be handed out as a smaller block later.
+        const size_t nRemaining = (pAvailableEnd - pAvailableBegin) / ALIGN_BYTES;
+        if (nRemaining > 0) PushFree(pAvailableBegin, nRemaining);
+
+        void* chunk = ::operator new(nChunkSizeBytes);
+        vChunks.push_back(chunk);
+        pAvailableBegin = static_cast<char*>(chunk);
+        pAvailableEnd = pAvailableBegin + nChunkSizeBytes;
+    }
+
+public:
+    //! Default size of the chunks blocks are taken from
+    static const size_t DEFAULT_CHUNK_SIZE_BYTES = 256 * 1024;
+
+    explicit PoolResource(size_t nChunkSizeBytesIn = DEFAULT_CHUNK_SIZE_BYTES) : nChunkSizeBytes(nChunkSizeBytesIn / ALIGN_BYTES * ALIGN_BYTES)
+    {
+        assert(nChunkSizeBytes >= MAX_BLOCK_SIZE_BYTES);
+        std::fill(freeLists, freeLists + NUM_FREE_LISTS, nullptr);
+    }
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    ~PoolResource()
+    {
+        for (void* chunk : vChunks) {
+            ::operator delete(chunk);
+        }
+    }
+
+    //! Allocate a block of memory of at least the given size and alignment.
+    void* Allocate(size_t bytes, size_t alignment)
+    {
+        if (!IsFreeListUsable(bytes, alignment)) {
+            assert(alignment <= alignof(max_align_t));
+            return ::operator new(bytes);
+        }
+        const size_t nAlignments = NumAlignments(bytes);
+        const size_t nBytes = nAlignments * ALIGN_BYTES;
+        nAllocatedBytes += nBytes;
+        if (freeLists[nAlignments] != nullptr) {
+            ListNode* node = freeLists[nAlignments];
+            freeLists[nAlignments] = node->next;
+            node->~ListNode();
+            return node;
+        }
+        if (static_cast<size_t>(pAvailableEnd - pAvailableBegin) < nBytes) {
+            AllocateChunk();
+        }
+        void* p = pAvailableBegin;
+        pAvailableBegin += nBytes;
+        return p;
+    }
+
+    //! Return a block obtained from Allocate with the same size and alignment.
+    void Deallocate(void* p, size_t bytes, size_t alignment) noexcept
+    {
+        if (!IsFreeListUsable(bytes, alignment)) {
+            ::operator delete(p);
+            return;
+        }
+        const size_t nAlignments = NumAlignments(bytes);
+        nAllocatedBytes -= nAlignments * ALIGN_BYTES;
+        PushFree(p, nAlignments);
+    }
+
+    //! Number of chunks allocated so far
+    size_t NumAllocatedChunks() const { return vChunks.size(); }
+
+    //! Size of every chunk
+    size_t ChunkSizeBytes() const { return nChunkSizeBytes; }
+
+    //! Total size of the blocks from the chunks that are in use
+    size_t AllocatedBytes() const { return nAllocatedBytes; }
+};
+
+/**
+ * Allocator that takes its memory from a PoolResource, which must outlive the
+ * allocator and all its copies. Meant for node based containers such as
+ * std::unordered_map, with MAX_BLOCK_SIZE_BYTES chosen large enough to hold
+ * a node; bucket arrays and other large allocations bypass the pool.
+ */
+template <class T, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES = alignof(T)>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> ResourceType;
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> other;
+    };
+
+    explicit PoolAllocator(ResourceType* resourceIn) noexcept : resource(resourceIn) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& other) noexcept : resource(other.GetResource()) {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    ResourceType* GetResource() const noexcept { return resource; }
+
+private:
+    ResourceType* resource;
+};
+
+template <class T1, class T2, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+bool operator==(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a, const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return a.GetResource() == b.GetResource();
+}
+
+template <class T1, class T2, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+bool operator!=(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a, const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return !(a == b);
+}
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
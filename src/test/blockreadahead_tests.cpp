@@ -0,0 +1,101 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockreadahead.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <test/setup_common.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockreadahead_tests, TestChain100Setup)
+
+static void TestReadAhead(int nThreads)
+{
+    const Consensus::Params& params = Params().GetConsensus();
+    CBlockReadAhead readahead;
+    boost::thread_group threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.create_thread([&readahead]() { readahead.Thread(); });
+    }
+
+    std::vector<std::pair<uint256, FlatFilePos>> vWindow;
+    {
+        LOCK(cs_main);
+        for (int nHeight = 1; nHeight <= 10; nHeight++) {
+            const CBlockIndex* pindex = ::ChainActive()[nHeight];
+            vWindow.emplace_back(pindex->GetBlockHash(), pindex->GetBlockPos());
+        }
+    }
+    readahead.SetWindow(vWindow, params);
+
+    for (const auto& block : vWindow) {
+        std::shared_ptr<const CBlock> pblock = readahead.Get(block.first, block.second, params);
+        BOOST_REQUIRE(pblock);
+        BOOST_CHECK_EQUAL(pblock->GetHash(), block.first);
+        BOOST_CHECK(pblock->fChecked);
+        // Blocks stay available until they drop out of the window.
+        BOOST_CHECK_EQUAL(readahead.Get(block.first, block.second, params), pblock);
+    }
+
+    // Blocks outside the window are read by the caller.
+    readahead.SetWindow({}, params);
+    std::shared_ptr<const CBlock> pblock = readahead.Get(vWindow[0].first, vWindow[0].second, params);
+    BOOST_REQUIRE(pblock);
+    BOOST_CHECK_EQUAL(pblock->GetHash(), vWindow[0].first);
+
+    // A block that does not match its hash is not handed out.
+    readahead.SetWindow({{vWindow[1].first, vWindow[0].second}}, params);
+    BOOST_CHECK(!readahead.Get(vWindow[1].first, vWindow[0].second, params));
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(readahead_no_workers)
+{
+    TestReadAhead(0);
+}
+
+BOOST_AUTO_TEST_CASE(readahead_workers)
+{
+    TestReadAhead(3);
+}
+
+BOOST_AUTO_TEST_CASE(readahead_reconnect)
+{
+    // Disconnect the last blocks, and connect them again with read-ahead and
+    // input prefetching enabled.
+    boost::thread_group threads;
+    nBlockReadAhead = 4;
+    nCoinsPrefetchThreads = 2;
+    for (int i = 0; i < nBlockReadAhead; i++) {
+        threads.create_thread([i]() { ThreadBlockReadAhead(i); });
+    }
+    for (int i = 0; i < nCoinsPrefetchThreads; i++) {
+        threads.create_thread([i]() { ThreadCoinsPrefetch(i); });
+    }
+
+    CValidationState state;
+    CBlockIndex* pindexTip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    CBlockIndex* pindexInvalidate = WITH_LOCK(cs_main, return ::ChainActive()[90]);
+    BOOST_CHECK(InvalidateBlock(state, Params(), pindexInvalidate));
+    BOOST_CHECK_EQUAL(WITH_LOCK(cs_main, return ::ChainActive().Height()), 89);
+    {
+        LOCK(cs_main);
+        ResetBlockFailureFlags(pindexInvalidate);
+    }
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    BOOST_CHECK_EQUAL(WITH_LOCK(cs_main, return ::ChainActive().Tip()), pindexTip);
+
+    threads.interrupt_all();
+    threads.join_all();
+    nBlockReadAhead = 0;
+    nCoinsPrefetchThreads = 0;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
 #include <coins.h>
 #include <script/standard.h>
 #include <test/setup_common.h>
+#include <txdb.h>
 #include <uint256.h>
 #include <undo.h>
 #include <util/strencodings.h>
@@ -51,7 +52,7 @@ public:
 
     uint256 GetBestBlock() const override { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) override
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase = true) override
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
@@ -62,7 +63,11 @@ public:
                     map_.erase(it->first);
                 }
             }
-            mapCoins.erase(it++);
+            if (erase) {
+                mapCoins.erase(it++);
+            } else {
+                ++it;
+            }
         }
         if (!hashBlock.IsNull())
             hashBestBlock_ = hashBlock;
@@ -590,7 +595,8 @@ void GetCoinsMapEntry(const CCoinsMap& map, CAmount& value, char& flags)
 
 void WriteCoinsViewEntry(CCoinsView& view, CAmount value, char flags)
 {
-    CCoinsMap map;
+    CCoinsMapMemoryResource resource;
+    CCoinsMap map(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), CCoinsMap::allocator_type(&resource));
     InsertCoinsMapEntry(map, value, flags);
     BOOST_CHECK(view.BatchWrite(map, {}));
 }
@@ -859,4 +865,148 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_sync)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    cache.SetBestBlock(InsecureRand256());
+
+    Coin coin;
+    coin.out.nValue = InsecureRand32();
+    coin.out.scriptPubKey.assign(InsecureRandBits(6), 0);
+    coin.nHeight = 1;
+
+    // Coins that are already in the base, and coins that are new.
+    std::vector<COutPoint> old_outpoints, new_outpoints;
+    for (int i = 0; i < 10; i++) {
+        old_outpoints.emplace_back(InsecureRand256(), 0);
+        cache.AddCoin(old_outpoints.back(), Coin(coin), false);
+    }
+    BOOST_CHECK(cache.Flush());
+    for (const COutPoint& outpoint : old_outpoints) {
+        BOOST_CHECK(!cache.AccessCoin(outpoint).IsSpent());
+    }
+    for (int i = 0; i < 10; i++) {
+        new_outpoints.emplace_back(InsecureRand256(), 0);
+        cache.AddCoin(new_outpoints.back(), Coin(coin), false);
+    }
+    BOOST_CHECK(cache.SpendCoin(old_outpoints.back()));
+    old_outpoints.pop_back();
+
+    // Without a limit, the unspent coins stay in the cache as unmodified
+    // entries, and the spent one is removed.
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 19U);
+    for (const auto& entry : cache.map()) {
+        BOOST_CHECK_EQUAL(entry.second.flags, 0);
+    }
+    cache.SelfTest();
+    CCoinsViewCacheTest check(&base);
+    for (const COutPoint& outpoint : new_outpoints) {
+        BOOST_CHECK(check.HaveCoin(outpoint));
+    }
+
+    // Coins that were unmodified before the call are evicted first.
+    std::vector<COutPoint> newest_outpoints;
+    for (int i = 0; i < 10; i++) {
+        newest_outpoints.emplace_back(InsecureRand256(), 0);
+        cache.AddCoin(newest_outpoints.back(), Coin(coin), false);
+    }
+    BOOST_CHECK(cache.Sync(cache.DynamicMemoryUsage() - 1));
+    BOOST_CHECK(cache.GetCacheSize() < 29U);
+    for (const COutPoint& outpoint : newest_outpoints) {
+        BOOST_CHECK(cache.HaveCoinInCache(outpoint));
+    }
+    cache.SelfTest();
+
+    // Everything can be evicted.
+    BOOST_CHECK(cache.Sync(0));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    for (const COutPoint& outpoint : newest_outpoints) {
+        BOOST_CHECK(cache.HaveCoin(outpoint));
+    }
+}
+
+//! Check that db holds exactly the coins in expected, through lookups and a cursor.
+static void CheckCoinsDB(const CCoinsViewDB& db, const std::map<COutPoint, Coin>& expected, const std::vector<COutPoint>& spent)
+{
+    for (const auto& entry : expected) {
+        Coin coin;
+        BOOST_CHECK(db.GetCoin(entry.first, coin));
+        BOOST_CHECK(coin == entry.second);
+        BOOST_CHECK(db.HaveCoin(entry.first));
+    }
+    for (const COutPoint& outpoint : spent) {
+        BOOST_CHECK(!db.HaveCoin(outpoint));
+    }
+    std::map<COutPoint, Coin> found;
+    std::unique_ptr<CCoinsViewCursor> cursor(db.Cursor());
+    for (; cursor->Valid(); cursor->Next()) {
+        COutPoint outpoint;
+        Coin coin;
+        BOOST_CHECK(cursor->GetKey(outpoint));
+        BOOST_CHECK(cursor->GetValue(coin));
+        BOOST_CHECK(cursor->GetValueSize() > 0);
+        found.emplace(outpoint, std::move(coin));
+    }
+    BOOST_CHECK_EQUAL(found.size(), expected.size());
+    for (const auto& entry : found) {
+        auto it = expected.find(entry.first);
+        BOOST_CHECK(it != expected.end() && it->second == entry.second);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_db_layouts)
+{
+    std::map<COutPoint, Coin> expected;
+    std::vector<COutPoint> spent;
+    uint256 hashBlock = InsecureRand256();
+    {
+        // Write some transactions with several outputs in the per-output layout.
+        CCoinsViewDB db(1 << 20, false, true, false);
+        CCoinsViewCache cache(&db);
+        for (int i = 0; i < 100; i++) {
+            const uint256 txid = InsecureRand256();
+            for (uint32_t n = 0; n < 1 + InsecureRandRange(5); n++) {
+                Coin coin(CTxOut(InsecureRandRange(1000) + 1, CScript() << OP_TRUE), 1 + i, false);
+                const COutPoint outpoint(txid, n * (1 + InsecureRandRange(300)));
+                cache.AddCoin(outpoint, Coin(coin), true);
+                expected[outpoint] = coin;
+            }
+        }
+        cache.SetBestBlock(hashBlock);
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK(db.Upgrade());
+        CheckCoinsDB(db, expected, spent);
+    }
+
+    for (const bool fGrouped : {true, false, true}) {
+        // Reopening in the other layout converts the database.
+        CCoinsViewDB db(1 << 20, false, false, fGrouped);
+        BOOST_CHECK(db.Upgrade());
+        BOOST_CHECK_EQUAL(db.GetBestBlock(), hashBlock);
+        CheckCoinsDB(db, expected, spent);
+
+        // Spend and add some coins, including single outputs of transactions
+        // that have others left.
+        CCoinsViewCache cache(&db);
+        for (int i = 0; i < 20; i++) {
+            auto it = expected.begin();
+            std::advance(it, InsecureRandRange(expected.size()));
+            BOOST_CHECK(cache.SpendCoin(it->first));
+            spent.push_back(it->first);
+            expected.erase(it);
+
+            Coin coin(CTxOut(InsecureRandRange(1000) + 1, CScript() << OP_TRUE), 200, false);
+            const COutPoint outpoint(InsecureRand256(), InsecureRandRange(3));
+            cache.AddCoin(outpoint, Coin(coin), true);
+            expected[outpoint] = coin;
+        }
+        hashBlock = InsecureRand256();
+        cache.SetBestBlock(hashBlock);
+        BOOST_CHECK(cache.Flush());
+        CheckCoinsDB(db, expected, spent);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
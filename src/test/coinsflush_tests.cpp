@@ -0,0 +1,199 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <coinsflush.h>
+#include <test/setup_common.h>
+
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+namespace {
+
+//! View whose writes can be held back, or made to fail.
+class CCoinsViewBlocking : public CCoinsView
+{
+    mutable boost::mutex mutex;
+    boost::condition_variable cond;
+    std::map<COutPoint, Coin> map;
+    uint256 hashBestBlock;
+    bool fBlocked = false;
+    bool fFail = false;
+
+public:
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        auto it = map.find(outpoint);
+        if (it == map.end()) return false;
+        coin = it->second;
+        return true;
+    }
+
+    uint256 GetBestBlock() const override
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return hashBestBlock;
+    }
+
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase = true) override
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (fBlocked) {
+            cond.wait(lock);
+        }
+        if (fFail) return false;
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = erase ? mapCoins.erase(it) : std::next(it)) {
+            if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) continue;
+            if (it->second.coin.IsSpent()) {
+                map.erase(it->first);
+            } else {
+                map[it->first] = it->second.coin;
+            }
+        }
+        hashBestBlock = hashBlock;
+        return true;
+    }
+
+    void SetBlocked(bool fBlockedIn)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fBlocked = fBlockedIn;
+        cond.notify_all();
+    }
+
+    void SetFail(bool fFailIn)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fFail = fFailIn;
+    }
+};
+
+void StartWriter(boost::thread& thread, CCoinsViewFlusher& flusher, bool& fWriterOk)
+{
+    thread = boost::thread([&flusher, &fWriterOk]() { fWriterOk = flusher.Thread(); });
+    while (!flusher.IsAsync()) {
+        boost::this_thread::yield();
+    }
+}
+
+Coin RandomCoin()
+{
+    return Coin(CTxOut(InsecureRandRange(1000) + 1, CScript() << OP_TRUE), 1, false);
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(coinsflush_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(flush_without_writer)
+{
+    CCoinsViewBlocking base;
+    CCoinsViewFlusher flusher(&base);
+    CCoinsViewCache cache(&flusher);
+
+    const COutPoint outpoint(InsecureRand256(), 0);
+    const uint256 hashBlock = InsecureRand256();
+    cache.AddCoin(outpoint, RandomCoin(), false);
+    cache.SetBestBlock(hashBlock);
+    BOOST_CHECK(cache.Flush());
+
+    // Without a writer thread, the batch is written right away.
+    BOOST_CHECK_EQUAL(base.GetBestBlock(), hashBlock);
+    BOOST_CHECK(base.HaveCoin(outpoint));
+    BOOST_CHECK_EQUAL(flusher.DynamicMemoryUsage(), 0U);
+    BOOST_CHECK(flusher.Wait());
+}
+
+BOOST_AUTO_TEST_CASE(flush_in_background)
+{
+    CCoinsViewBlocking base;
+    CCoinsViewFlusher flusher(&base);
+    CCoinsViewCache cache(&flusher);
+    boost::thread writer;
+    bool fWriterOk;
+    StartWriter(writer, flusher, fWriterOk);
+
+    const COutPoint outpoint_old(InsecureRand256(), 0);
+    const uint256 hashOld = InsecureRand256();
+    cache.AddCoin(outpoint_old, RandomCoin(), false);
+    cache.SetBestBlock(hashOld);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(flusher.Wait());
+    BOOST_CHECK(base.HaveCoin(outpoint_old));
+
+    // Hold back the next write, and check that the frozen batch is visible
+    // through the flusher while the base is unchanged.
+    base.SetBlocked(true);
+    const COutPoint outpoint_new(InsecureRand256(), 0);
+    const uint256 hashNew = InsecureRand256();
+    BOOST_CHECK(cache.SpendCoin(outpoint_old));
+    cache.AddCoin(outpoint_new, RandomCoin(), false);
+    cache.SetBestBlock(hashNew);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+
+    BOOST_CHECK_EQUAL(base.GetBestBlock(), hashOld);
+    BOOST_CHECK(base.HaveCoin(outpoint_old));
+    BOOST_CHECK(!base.HaveCoin(outpoint_new));
+    BOOST_CHECK_EQUAL(flusher.GetBestBlock(), hashNew);
+    BOOST_CHECK(!flusher.HaveCoin(outpoint_old));
+    BOOST_CHECK(flusher.HaveCoin(outpoint_new));
+    BOOST_CHECK(!cache.HaveCoin(outpoint_old));
+    BOOST_CHECK(cache.HaveCoin(outpoint_new));
+    BOOST_CHECK(flusher.DynamicMemoryUsage() > 0);
+
+    // The cache keeps accepting changes meanwhile.
+    const COutPoint outpoint_next(InsecureRand256(), 0);
+    cache.AddCoin(outpoint_next, RandomCoin(), false);
+    BOOST_CHECK(cache.HaveCoin(outpoint_next));
+
+    base.SetBlocked(false);
+    BOOST_CHECK(flusher.Wait());
+    BOOST_CHECK_EQUAL(base.GetBestBlock(), hashNew);
+    BOOST_CHECK(!base.HaveCoin(outpoint_old));
+    BOOST_CHECK(base.HaveCoin(outpoint_new));
+    BOOST_CHECK(!base.HaveCoin(outpoint_next));
+    BOOST_CHECK_EQUAL(flusher.DynamicMemoryUsage(), 0U);
+
+    // A batch handed off right before the writer is interrupted is still written.
+    base.SetBlocked(true);
+    BOOST_CHECK(cache.Flush());
+    writer.interrupt();
+    base.SetBlocked(false);
+    writer.join();
+    BOOST_CHECK(base.HaveCoin(outpoint_next));
+    BOOST_CHECK(!flusher.IsAsync());
+    BOOST_CHECK(flusher.Wait());
+}
+
+BOOST_AUTO_TEST_CASE(flush_failure)
+{
+    CCoinsViewBlocking base;
+    CCoinsViewFlusher flusher(&base);
+    CCoinsViewCache cache(&flusher);
+    boost::thread writer;
+    bool fWriterOk;
+    StartWriter(writer, flusher, fWriterOk);
+
+    base.SetFail(true);
+    const COutPoint outpoint(InsecureRand256(), 0);
+    cache.AddCoin(outpoint, RandomCoin(), false);
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!flusher.Wait());
+    writer.join();
+    BOOST_CHECK(!fWriterOk);
+
+    // The batch that could not be written stays visible, and no further
+    // writes are accepted.
+    BOOST_CHECK(flusher.HaveCoin(outpoint));
+    base.SetFail(false);
+    cache.AddCoin(COutPoint(InsecureRand256(), 0), RandomCoin(), false);
+    BOOST_CHECK(!cache.Flush());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,142 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <coinsprefetch.h>
+#include <primitives/block.h>
+#include <test/setup_common.h>
+
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+namespace {
+
+//! Read-only view that is safe to query from several threads.
+class CCoinsViewMap : public CCoinsView
+{
+public:
+    std::map<COutPoint, Coin> map;
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override
+    {
+        auto it = map.find(outpoint);
+        if (it == map.end()) return false;
+        coin = it->second;
+        return true;
+    }
+};
+
+COutPoint AddRandomCoin(CCoinsViewMap& view)
+{
+    COutPoint outpoint(InsecureRand256(), InsecureRandRange(4));
+    CTxOut txout(InsecureRandRange(1000) + 1, CScript() << OP_TRUE);
+    view.map.emplace(outpoint, Coin(txout, 1, false));
+    return outpoint;
+}
+
+CMutableTransaction SpendingTx(const std::vector<COutPoint>& prevouts)
+{
+    CMutableTransaction tx;
+    for (const COutPoint& prevout : prevouts) {
+        tx.vin.emplace_back(prevout);
+    }
+    tx.vout.emplace_back(1, CScript() << OP_TRUE);
+    return tx;
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(coinsprefetch_tests, BasicTestingSetup)
+
+static void TestPrefetch(int nThreads)
+{
+    CCoinsViewMap base;
+    CCoinsViewCache cache(&base);
+    CCoinsPrefetcher prefetcher(4);
+    boost::thread_group threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.create_thread([&prefetcher]() { prefetcher.Thread(); });
+    }
+
+    // Coins that only exist in the backing view.
+    std::vector<COutPoint> vPrefetch;
+    for (int i = 0; i < 50; i++) {
+        vPrefetch.push_back(AddRandomCoin(base));
+    }
+    // A coin already spent in the cache must not be resurrected.
+    COutPoint spent = AddRandomCoin(base);
+    BOOST_CHECK(cache.SpendCoin(spent));
+    BOOST_CHECK(!cache.HaveCoin(spent));
+    // A coin that does not exist anywhere.
+    COutPoint missing(InsecureRand256(), 0);
+
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.emplace_back(50, CScript() << OP_TRUE);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    std::vector<COutPoint> vSpend(vPrefetch);
+    vSpend.push_back(spent);
+    vSpend.push_back(missing);
+    CTransactionRef tx = MakeTransactionRef(SpendingTx(vSpend));
+    block.vtx.push_back(tx);
+    // An input created earlier in the same block.
+    block.vtx.push_back(MakeTransactionRef(SpendingTx({COutPoint(tx->GetHash(), 0)})));
+
+    prefetcher.Prefetch(&base, cache, block);
+    BOOST_CHECK_EQUAL(prefetcher.Apply(cache), vPrefetch.size());
+    for (const COutPoint& outpoint : vPrefetch) {
+        BOOST_CHECK(cache.HaveCoinInCache(outpoint));
+        BOOST_CHECK(cache.AccessCoin(outpoint).out == base.map.at(outpoint).out);
+    }
+    BOOST_CHECK(!cache.HaveCoin(spent));
+    BOOST_CHECK(!cache.HaveCoinInCache(missing));
+    // Previously spent coin plus the prefetched ones.
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), vPrefetch.size() + 1);
+
+    // Prefetching again is a no-op, as everything is cached already.
+    prefetcher.Prefetch(&base, cache, block);
+    BOOST_CHECK_EQUAL(prefetcher.Apply(cache), 0U);
+
+    // Discarded lookups never reach the cache.
+    for (const COutPoint& outpoint : vPrefetch) {
+        cache.Uncache(outpoint);
+    }
+    prefetcher.Prefetch(&base, cache, block);
+    prefetcher.Discard();
+    BOOST_CHECK_EQUAL(prefetcher.Apply(cache), 0U);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1U);
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_no_workers)
+{
+    TestPrefetch(0);
+}
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_workers)
+{
+    TestPrefetch(4);
+}
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_warmcoin)
+{
+    CCoinsViewMap base;
+    CCoinsViewCache cache(&base);
+    COutPoint outpoint(InsecureRand256(), 0);
+
+    // A warmed coin is not dirty, and is never overwritten by another one.
+    BOOST_CHECK(cache.WarmCoin(outpoint, Coin(CTxOut(1, CScript() << OP_TRUE), 1, false)));
+    BOOST_CHECK(cache.HaveCoinInCache(outpoint));
+    BOOST_CHECK(!cache.WarmCoin(outpoint, Coin(CTxOut(2, CScript() << OP_TRUE), 1, false)));
+    BOOST_CHECK_EQUAL(cache.AccessCoin(outpoint).out.nValue, 1);
+    cache.Uncache(outpoint);
+    BOOST_CHECK(!cache.HaveCoinInCache(outpoint));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,123 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <hash.h>
+#include <node/coinstats.h>
+#include <test/setup_common.h>
+#include <txdb.h>
+#include <validation.h>
+
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+//! Hash the UTXO set the way a single cursor walk over it does.
+uint256 SerialHash(CCoinsView& view)
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor(view.Cursor());
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << pcursor->GetBestBlock();
+    std::map<uint256, std::map<uint32_t, Coin>> txs;
+    for (; pcursor->Valid(); pcursor->Next()) {
+        COutPoint key;
+        Coin coin;
+        BOOST_REQUIRE(pcursor->GetKey(key) && pcursor->GetValue(coin));
+        txs[key.hash][key.n] = coin;
+    }
+    // Transactions are stored in the order of their serialized hashes.
+    std::vector<std::pair<uint256, std::map<uint32_t, Coin>>> sorted(txs.begin(), txs.end());
+    std::sort(sorted.begin(), sorted.end(), [](const std::pair<uint256, std::map<uint32_t, Coin>>& a, const std::pair<uint256, std::map<uint32_t, Coin>>& b) {
+        return std::lexicographical_compare(a.first.begin(), a.first.end(), b.first.begin(), b.first.end());
+    });
+    for (const auto& tx : sorted) {
+        const Coin& first = tx.second.begin()->second;
+        ss << tx.first;
+        ss << VARINT(first.nHeight * 2 + first.fCoinBase ? 1u : 0u);
+        for (const auto& output : tx.second) {
+            ss << VARINT(output.first + 1);
+            ss << output.second.out.scriptPubKey;
+            ss << VARINT(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
+        }
+        ss << VARINT(0u);
+    }
+    return ss.GetHash();
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(coinstats_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(utxo_stats_threads)
+{
+    // Spread coins over many ranges of transaction hashes.
+    {
+        LOCK(cs_main);
+        for (int i = 0; i < 1000; ++i) {
+            Coin coin(CTxOut(InsecureRandRange(1000) + 1, CScript() << OP_TRUE), 1, false);
+            pcoinsTip->AddCoin(COutPoint(InsecureRand256(), InsecureRandRange(3)), std::move(coin), false);
+        }
+    }
+    ::ChainstateActive().ForceFlushStateToDisk();
+
+    CCoinsStats stats_serial;
+    BOOST_REQUIRE(GetUTXOStats(pcoinsdbview.get(), stats_serial, 1));
+    BOOST_CHECK_EQUAL(stats_serial.nHeight, 100);
+    BOOST_CHECK_EQUAL(stats_serial.hashBlock, ::ChainActive().Tip()->GetBlockHash());
+    BOOST_CHECK_EQUAL(stats_serial.hashSerialized, SerialHash(*pcoinsdbview));
+    BOOST_CHECK(stats_serial.nTransactions > 1000);
+
+    for (int threads : {2, 3, 16}) {
+        CCoinsStats stats;
+        BOOST_REQUIRE(GetUTXOStats(pcoinsdbview.get(), stats, threads));
+        BOOST_CHECK_EQUAL(stats.hashSerialized, stats_serial.hashSerialized);
+        BOOST_CHECK_EQUAL(stats.nTransactions, stats_serial.nTransactions);
+        BOOST_CHECK_EQUAL(stats.nTransactionOutputs, stats_serial.nTransactionOutputs);
+        BOOST_CHECK_EQUAL(stats.nBogoSize, stats_serial.nBogoSize);
+        BOOST_CHECK_EQUAL(stats.nTotalAmount, stats_serial.nTotalAmount);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(coins_db_cursors)
+{
+    uint256 start_low, start_high;
+    *start_high.begin() = 0x80;
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors = pcoinsdbview->Cursors({start_low, start_high});
+    BOOST_REQUIRE_EQUAL(cursors.size(), 2U);
+    const uint256 hashBlock = pcoinsdbview->GetBestBlock();
+    BOOST_CHECK_EQUAL(cursors[0]->GetBestBlock(), hashBlock);
+
+    // Changes after the cursors were created are not visible to them.
+    COutPoint outpoint(InsecureRand256(), 0);
+    *outpoint.hash.begin() = 0x80;
+    {
+        LOCK(cs_main);
+        pcoinsTip->AddCoin(outpoint, Coin(CTxOut(1, CScript() << OP_TRUE), 1, false), false);
+        pcoinsTip->SetBestBlock(InsecureRand256());
+    }
+    BOOST_CHECK(pcoinsTip->Flush());
+    BOOST_CHECK(pcoinsdbview->HaveCoin(outpoint));
+
+    size_t count_low = 0, count_high = 0;
+    for (; cursors[0]->Valid(); cursors[0]->Next()) {
+        COutPoint key;
+        BOOST_REQUIRE(cursors[0]->GetKey(key));
+        BOOST_CHECK(key != outpoint);
+        ++count_low;
+    }
+    for (; cursors[1]->Valid(); cursors[1]->Next()) {
+        COutPoint key;
+        BOOST_REQUIRE(cursors[1]->GetKey(key));
+        BOOST_CHECK(*key.hash.begin() >= 0x80);
+        BOOST_CHECK(key != outpoint);
+        ++count_high;
+    }
+    // The first cursor covers all transactions, the second the upper half.
+    BOOST_CHECK(count_low >= count_high);
+    BOOST_CHECK_EQUAL(cursors[1]->GetBestBlock(), hashBlock);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,136 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <crypto/muhash.h>
+#include <index/coinstatsindex.h>
+#include <node/coinstats.h>
+#include <script/interpreter.h>
+#include <test/setup_common.h>
+#include <txdb.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+//! Compare the statistics of the index at the tip with a scan of the UTXO set.
+void CheckTipStats(const CoinStatsIndex& index)
+{
+    ::ChainstateActive().ForceFlushStateToDisk();
+
+    CCoinsStats scan_stats;
+    BOOST_REQUIRE(GetUTXOStats(pcoinsdbview.get(), scan_stats));
+
+    MuHash3072 muhash;
+    std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor());
+    for (; pcursor->Valid(); pcursor->Next()) {
+        COutPoint key;
+        Coin coin;
+        BOOST_REQUIRE(pcursor->GetKey(key) && pcursor->GetValue(coin));
+        ApplyCoinHash(muhash, key, coin);
+    }
+    uint256 scan_muhash;
+    muhash.Finalize(scan_muhash);
+
+    CCoinsStats index_stats;
+    const CBlockIndex* tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    BOOST_REQUIRE(index.LookUpStats(tip, index_stats));
+    BOOST_CHECK_EQUAL(index_stats.nHeight, scan_stats.nHeight);
+    BOOST_CHECK_EQUAL(index_stats.hashBlock, scan_stats.hashBlock);
+    BOOST_CHECK_EQUAL(index_stats.nTransactionOutputs, scan_stats.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(index_stats.nBogoSize, scan_stats.nBogoSize);
+    BOOST_CHECK_EQUAL(index_stats.nTotalAmount, scan_stats.nTotalAmount);
+    BOOST_CHECK_EQUAL(index_stats.hashMuHash, scan_muhash);
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(coinstatsindex_tests)
+
+BOOST_FIXTURE_TEST_CASE(coinstatsindex_initial_sync, TestChain100Setup)
+{
+    CoinStatsIndex coin_stats_index(1 << 20, true);
+
+    CCoinsStats stats;
+    const CBlockIndex* tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+
+    // Statistics should not be found in the index before it is started.
+    BOOST_CHECK(!coin_stats_index.LookUpStats(tip, stats));
+
+    // BlockUntilSyncedToCurrentChain should return false before the index is started.
+    BOOST_CHECK(!coin_stats_index.BlockUntilSyncedToCurrentChain());
+
+    coin_stats_index.Start();
+
+    // Allow the index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!coin_stats_index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    // The genesis block outputs are not in the UTXO set.
+    const CBlockIndex* genesis = WITH_LOCK(cs_main, return ::ChainActive().Genesis());
+    BOOST_REQUIRE(coin_stats_index.LookUpStats(genesis, stats));
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 0U);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, 0);
+
+    CheckTipStats(coin_stats_index);
+
+    // Spend a coinbase output in a new block, so the index has to remove it.
+    CScript coinbase_script_pub_key = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetHash(), 0);
+    spend.vout.resize(2);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = coinbase_script_pub_key;
+    spend.vout[1].nValue = 0;
+    spend.vout[1].scriptPubKey = CScript() << OP_RETURN;
+    std::vector<unsigned char> sig;
+    uint256 hash = SignatureHash(coinbase_script_pub_key, spend, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_REQUIRE(coinbaseKey.Sign(hash, sig));
+    sig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << sig;
+
+    const CBlock block = CreateAndProcessBlock({spend}, coinbase_script_pub_key);
+    BOOST_REQUIRE_EQUAL(WITH_LOCK(cs_main, return ::ChainActive().Tip()->GetBlockHash()), block.GetHash());
+    BOOST_CHECK(coin_stats_index.BlockUntilSyncedToCurrentChain());
+    CheckTipStats(coin_stats_index);
+
+    CCoinsStats stats_before_reorg;
+    CBlockIndex* block_index = WITH_LOCK(cs_main, return LookupBlockIndex(block.GetHash()));
+    BOOST_REQUIRE(coin_stats_index.LookUpStats(block_index, stats_before_reorg));
+
+    // Replace the block with two others, so the index has to rewind it.
+    CValidationState state;
+    BOOST_REQUIRE(InvalidateBlock(state, Params(), block_index));
+    // The spend returns to the mempool, where it would add its fee to the coinbase.
+    mempool.clear();
+    CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    BOOST_CHECK_EQUAL(WITH_LOCK(cs_main, return ::ChainActive().Height()), 102);
+    BOOST_CHECK(coin_stats_index.BlockUntilSyncedToCurrentChain());
+    CheckTipStats(coin_stats_index);
+
+    // The statistics of the disconnected block can still be looked up.
+    BOOST_REQUIRE(coin_stats_index.LookUpStats(block_index, stats));
+    BOOST_CHECK_EQUAL(stats.hashMuHash, stats_before_reorg.hashMuHash);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, stats_before_reorg.nTransactionOutputs);
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    coin_stats_index.Stop();
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+}
+
+BOOST_AUTO_TEST_SUITE_END()
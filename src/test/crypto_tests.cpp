@@ -8,6 +8,7 @@
 #include <crypto/hkdf_sha256_32.h>
 #include <crypto/hmac_sha256.h>
 #include <crypto/hmac_sha512.h>
+#include <crypto/muhash.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
@@ -623,4 +624,78 @@ BOOST_AUTO_TEST_CASE(sha256d64)
     }
 }
 
+static MuHash3072 FromInt(unsigned char i) {
+    unsigned char tmp[32] = {i, 0};
+    return MuHash3072(MakeSpan(tmp));
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    uint256 out;
+
+    for (int iter = 0; iter < 10; ++iter) {
+        uint256 res;
+        int table[4];
+        for (int i = 0; i < 4; ++i) {
+            table[i] = InsecureRandBits(3);
+        }
+        for (int order = 0; order < 4; ++order) {
+            MuHash3072 acc;
+            for (int i = 0; i < 4; ++i) {
+                int t = table[i ^ order];
+                if (t & 4) {
+                    acc /= FromInt(t & 3);
+                } else {
+                    acc *= FromInt(t & 3);
+                }
+            }
+            acc.Finalize(out);
+            if (order == 0) {
+                res = out;
+            } else {
+                BOOST_CHECK(res == out);
+            }
+        }
+
+        MuHash3072 x = FromInt(InsecureRandBits(4)); // x=X
+        MuHash3072 y = FromInt(InsecureRandBits(4)); // x=X, y=Y
+        MuHash3072 z;                                // x=X, y=Y, z=1
+        z *= x;                                      // x=X, y=Y, z=X
+        z *= y;                                      // x=X, y=Y, z=X*Y
+        y *= x;                                      // x=X, y=Y*X, z=X*Y
+        z /= y;                                      // x=X, y=Y*X, z=1
+        z.Finalize(out);
+        uint256 out2;
+        MuHash3072().Finalize(out2);
+        BOOST_CHECK_EQUAL(out, out2);
+    }
+
+    MuHash3072 acc = FromInt(0);
+    acc *= FromInt(1);
+    acc /= FromInt(2);
+    acc.Finalize(out);
+    BOOST_CHECK_EQUAL(out, uint256S("10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863"));
+
+    // Inserting and removing elements matches multiplying and dividing by
+    // the hashes of single element sets.
+    const unsigned char data[] = {0x01, 0x02};
+    MuHash3072 inserted;
+    inserted.Insert(MakeSpan(data));
+    inserted.Insert(MakeSpan(data));
+    inserted.Remove(MakeSpan(data));
+    uint256 out_inserted;
+    inserted.Finalize(out_inserted);
+    MuHash3072(MakeSpan(data)).Finalize(out);
+    BOOST_CHECK_EQUAL(out, out_inserted);
+
+    // Serializing and deserializing the running state preserves it.
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << acc;
+    MuHash3072 acc_copy;
+    ss >> acc_copy;
+    uint256 out_copy;
+    acc_copy.Finalize(out_copy);
+    BOOST_CHECK_EQUAL(out_copy, uint256S("10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863"));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
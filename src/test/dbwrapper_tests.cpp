@@ -7,6 +7,7 @@
 #include <random.h>
 #include <test/setup_common.h>
 
+#include <algorithm>
 #include <memory>
 
 #include <boost/test/unit_test.hpp>
@@ -317,6 +318,124 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_params)
+{
+    const DBParams defaults;
+    DBParams params;
+    std::string error;
+
+    // Settings only apply to the database they name.
+    gArgs.ForceSetArg("-dbparam", "txindex.bloombits=0");
+    BOOST_CHECK(CheckDBParams(error));
+    BOOST_CHECK(ParseDBParams("chainstate", params, error));
+    BOOST_CHECK_EQUAL(params.bloom_bits, defaults.bloom_bits);
+    BOOST_CHECK(ParseDBParams("txindex", params, error));
+    BOOST_CHECK_EQUAL(params.bloom_bits, 0);
+
+    for (const std::string& setting : {"foo.blocksize=4096", "chainstate.foo=1", "chainstate.blocksize",
+                                       "chainstate.blocksize=x", "chainstate.blocksize=100", "chainstate.compression=2"}) {
+        gArgs.ForceSetArg("-dbparam", setting);
+        BOOST_CHECK(!CheckDBParams(error));
+    }
+
+    // The parameters are applied when the database is opened, and reported
+    // while it is open.
+    fs::path ph = SetDataDir("dbwrapper_params");
+    gArgs.ForceSetArg("-dbparam", "chainstate.writebuffersize=1048576");
+    {
+        CDBWrapper dbw(ph, 1 << 22, true, false, false, "chainstate");
+        std::vector<DBInfo> dbs = ListDBs();
+        auto it = std::find_if(dbs.begin(), dbs.end(), [&ph](const DBInfo& db) { return db.path == ph; });
+        BOOST_REQUIRE(it != dbs.end());
+        BOOST_CHECK_EQUAL(it->name, "chainstate");
+        BOOST_CHECK(it->in_memory);
+        BOOST_CHECK_EQUAL(it->cache_size, 1U << 22);
+        BOOST_CHECK_EQUAL(it->params.write_buffer_size, 1U << 20);
+        BOOST_CHECK_EQUAL(it->write_buffer_size, 1U << 20);
+        BOOST_CHECK_EQUAL(it->params.block_size, defaults.block_size);
+    }
+    for (const DBInfo& db : ListDBs()) {
+        BOOST_CHECK(db.path != ph);
+    }
+
+    // Without a name, the database is named after its directory.
+    {
+        CDBWrapper dbw(ph, 1 << 24, true, false, false);
+        BOOST_CHECK_EQUAL(dbw.GetInfo().name, "dbwrapper_params");
+        BOOST_CHECK_EQUAL(dbw.GetInfo().write_buffer_size, 1U << 22);
+    }
+
+    gArgs.ForceSetArg("-dbparam", "chainstate.blocksize=100");
+    BOOST_CHECK_THROW(CDBWrapper(ph, 1 << 22, true, false, false, "chainstate"), dbwrapper_error);
+
+    // Arguments cannot be unset; leave one that matches the defaults.
+    gArgs.ForceSetArg("-dbparam", "chainstate.blocksize=4096");
+}
 
+BOOST_AUTO_TEST_CASE(dbwrapper_stats)
+{
+    fs::path ph = SetDataDir("dbwrapper_stats");
+    CDBWrapper dbw(ph, 1 << 20, true, false, false);
+    // Opening the database looks up the obfuscation key.
+    const DBStats initial = dbw.GetStats();
+    BOOST_CHECK_EQUAL(initial.name, "dbwrapper_stats");
+    BOOST_CHECK_EQUAL(initial.reads, 1U);
+
+    const uint256 in = InsecureRand256();
+    uint256 res;
+    BOOST_CHECK(dbw.Write('k', in, true));
+    BOOST_CHECK(dbw.Read('k', res));
+    BOOST_CHECK(!dbw.Read('l', res));
+    BOOST_CHECK(dbw.Exists('k'));
+    BOOST_CHECK(!dbw.Exists('l'));
+    BOOST_CHECK(!dbw.Exists('m'));
+
+    DBStats stats = dbw.GetStats();
+    BOOST_CHECK_EQUAL(stats.reads, initial.reads + 2);
+    BOOST_CHECK_EQUAL(stats.reads_not_found, initial.reads_not_found + 1);
+    BOOST_CHECK_EQUAL(stats.read_bytes, initial.read_bytes + 32);
+    BOOST_CHECK_EQUAL(stats.exists, 3U);
+    BOOST_CHECK_EQUAL(stats.exists_not_found, 2U);
+    BOOST_CHECK_EQUAL(stats.batches, initial.batches + 1);
+    BOOST_CHECK_EQUAL(stats.batches_synced, initial.batches_synced + 1);
+    BOOST_CHECK(stats.batch_bytes > initial.batch_bytes);
+    BOOST_CHECK_EQUAL(stats.block_cache_capacity, 1U << 19);
+    BOOST_CHECK(!stats.files_per_level.empty());
+    BOOST_CHECK(stats.sstables.empty());
+    for (const auto& latency : {stats.read_latency, stats.exists_latency, stats.batch_latency}) {
+        BOOST_CHECK_EQUAL(latency.size(), (size_t)DBLatencyHistogram::BUCKETS);
+    }
+    uint64_t exists = 0;
+    for (uint64_t n : stats.exists_latency) exists += n;
+    BOOST_CHECK_EQUAL(exists, 3U);
+
+    // Once the data is in a table file, reads go through the block cache.
+    dbw.CompactRange('a', 'z');
+    BOOST_CHECK(dbw.Read('k', res));
+    BOOST_CHECK_EQUAL(res.ToString(), in.ToString());
+    stats = dbw.GetStats(true);
+    BOOST_CHECK(stats.block_cache_hits + stats.block_cache_misses > 0);
+    BOOST_CHECK(stats.approximate_size > 0);
+    BOOST_CHECK(!stats.sstables.empty());
+
+    std::vector<DBStats> dbs = GetDBStats();
+    BOOST_CHECK(std::any_of(dbs.begin(), dbs.end(), [&ph](const DBStats& db) { return db.path == ph; }));
+}
+
+BOOST_AUTO_TEST_CASE(dbwrapper_latency_histogram)
+{
+    DBLatencyHistogram histogram;
+    histogram.Add(std::chrono::microseconds{0});
+    histogram.Add(std::chrono::microseconds{1});
+    histogram.Add(std::chrono::microseconds{3});
+    histogram.Add(std::chrono::microseconds{4});
+    histogram.Add(std::chrono::hours{1});
+    std::vector<uint64_t> buckets = histogram.Get();
+    BOOST_CHECK_EQUAL(buckets[0], 1U);
+    BOOST_CHECK_EQUAL(buckets[1], 1U);
+    BOOST_CHECK_EQUAL(buckets[2], 1U);
+    BOOST_CHECK_EQUAL(buckets[3], 1U);
+    BOOST_CHECK_EQUAL(buckets[DBLatencyHistogram::BUCKETS - 1], 1U);
+}
 
 BOOST_AUTO_TEST_SUITE_END()
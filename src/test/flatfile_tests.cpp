@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <flatfile.h>
+#include <streams.h>
 #include <test/setup_common.h>
 
 #include <boost/test/unit_test.hpp>
@@ -120,4 +121,55 @@ BOOST_AUTO_TEST_CASE(flatfile_flush)
     BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(0, 1))), 1);
 }
 
+BOOST_AUTO_TEST_CASE(flatfile_map)
+{
+    auto data_dir = SetDataDir("flatfile_test");
+    FlatFileSeq seq(data_dir, "a", 100);
+
+    std::string line1("A purely peer-to-peer version of electronic cash");
+    std::string line2("would allow online payments");
+
+    // Missing and empty files cannot be mapped.
+    BOOST_CHECK(!seq.Map(FlatFilePos(0, 0)));
+    fclose(seq.Open(FlatFilePos(0, 0)));
+    BOOST_CHECK(!seq.Map(FlatFilePos(0, 0)));
+
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, 0)), SER_DISK, CLIENT_VERSION);
+        file << LIMITED_STRING(line1, 256);
+    }
+    size_t size1 = GetSerializeSize(line1, CLIENT_VERSION);
+
+    FlatFileMapCache cache;
+    std::shared_ptr<const FlatFileMapping> mapping = cache.Get(seq, FlatFilePos(0, 0), size1);
+    if (!mapping) {
+        // Memory mapping is not supported on this platform.
+        return;
+    }
+    BOOST_CHECK_EQUAL(mapping->Data().size(), size1);
+    BOOST_CHECK_EQUAL(cache.Get(seq, FlatFilePos(0, 0), 0), mapping);
+
+    std::string text;
+    SpanReader(SER_DISK, CLIENT_VERSION, mapping->Data()) >> LIMITED_STRING(text, 256);
+    BOOST_CHECK_EQUAL(text, line1);
+
+    // Appending to the file makes the cache map it again when needed.
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, size1)), SER_DISK, CLIENT_VERSION);
+        file << LIMITED_STRING(line2, 256);
+    }
+    size_t size2 = size1 + GetSerializeSize(line2, CLIENT_VERSION);
+    std::shared_ptr<const FlatFileMapping> mapping2 = cache.Get(seq, FlatFilePos(0, 0), size2);
+    BOOST_REQUIRE(mapping2);
+    BOOST_CHECK(mapping2 != mapping);
+    SpanReader(SER_DISK, CLIENT_VERSION, mapping2->Data().subspan(size1)) >> LIMITED_STRING(text, 256);
+    BOOST_CHECK_EQUAL(text, line2);
+    BOOST_CHECK(!cache.Get(seq, FlatFilePos(0, 0), size2 + 1));
+
+    // The old mapping stays valid while it is in use.
+    BOOST_CHECK_EQUAL(mapping->Data().size(), size1);
+    cache.Erase(0);
+    BOOST_CHECK(cache.Get(seq, FlatFilePos(0, 0), 0) != mapping2);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
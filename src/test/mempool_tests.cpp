@@ -749,4 +749,90 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 6ULL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolSnapshotTest)
+{
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool;
+
+    // A parent with two children, the second of which also has a grandchild
+    CMutableTransaction tx_parent;
+    tx_parent.vin.resize(1);
+    tx_parent.vin[0].scriptSig = CScript() << OP_11;
+    tx_parent.vout.resize(2);
+    for (CTxOut& out : tx_parent.vout) {
+        out.scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        out.nValue = 10 * COIN;
+    }
+    CMutableTransaction tx_child[2];
+    for (int i = 0; i < 2; i++) {
+        tx_child[i].vin.resize(1);
+        tx_child[i].vin[0].scriptSig = CScript() << OP_11;
+        tx_child[i].vin[0].prevout = COutPoint(tx_parent.GetHash(), i);
+        tx_child[i].vout.resize(1);
+        tx_child[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx_child[i].vout[0].nValue = 9 * COIN;
+    }
+    CMutableTransaction tx_grandchild;
+    tx_grandchild.vin.resize(1);
+    tx_grandchild.vin[0].scriptSig = CScript() << OP_11;
+    tx_grandchild.vin[0].prevout = COutPoint(tx_child[1].GetHash(), 0);
+    tx_grandchild.vout.resize(1);
+    tx_grandchild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx_grandchild.vout[0].nValue = 8 * COIN;
+
+    {
+        LOCK2(cs_main, pool.cs);
+        // Re-add the parent and one child after the others, as in a reorg,
+        // so the snapshot has to sort them
+        pool.addUnchecked(entry.Fee(1000).FromTx(tx_grandchild));
+        pool.addUnchecked(entry.Fee(3000).FromTx(tx_child[0]));
+        pool.addUnchecked(entry.Fee(4000).FromTx(tx_parent));
+        pool.addUnchecked(entry.Fee(2000).FromTx(tx_child[1]));
+        std::vector<uint256> to_update{tx_parent.GetHash(), tx_child[1].GetHash()};
+        pool.UpdateTransactionsFromBlock(to_update);
+    }
+
+    auto snapshot = pool.GetSnapshot(1000000);
+    BOOST_REQUIRE_EQUAL(snapshot->entries.size(), 4U);
+    BOOST_CHECK_EQUAL(snapshot->total_tx_size, pool.GetTotalTxSize());
+    const ptrdiff_t parent = snapshot->Find(tx_parent.GetHash());
+    const ptrdiff_t child0 = snapshot->Find(tx_child[0].GetHash());
+    const ptrdiff_t child1 = snapshot->Find(tx_child[1].GetHash());
+    const ptrdiff_t grandchild = snapshot->Find(tx_grandchild.GetHash());
+    BOOST_CHECK_EQUAL(parent, 0);
+    BOOST_CHECK_EQUAL(grandchild, 3);
+    BOOST_CHECK_EQUAL(snapshot->Find(uint256()), -1);
+
+    BOOST_CHECK_EQUAL(snapshot->entries[parent].count_with_descendants, 4U);
+    BOOST_CHECK_EQUAL(snapshot->entries[grandchild].count_with_ancestors, 3U);
+    BOOST_CHECK_EQUAL(snapshot->entries[grandchild].mod_fees_with_ancestors, 7000);
+    BOOST_CHECK_EQUAL(snapshot->GetDescendants(parent).size(), 3U);
+    BOOST_CHECK_EQUAL(snapshot->GetDescendants(child0).size(), 0U);
+    const std::vector<size_t> ancestors = snapshot->GetAncestors(grandchild);
+    BOOST_CHECK(std::set<size_t>(ancestors.begin(), ancestors.end()) == std::set<size_t>({(size_t)parent, (size_t)child1}));
+
+    // The snapshot is shared until the mempool changes
+    BOOST_CHECK(pool.GetSnapshot(1000000) == snapshot);
+    pool.PrioritiseTransaction(tx_child[1].GetHash(), 500);
+    auto prioritised = pool.GetSnapshot(1000000);
+    BOOST_CHECK(prioritised != snapshot);
+    BOOST_CHECK_EQUAL(prioritised->entries[grandchild].mod_fees_with_ancestors, 7500);
+    // The old snapshot is still valid for readers that hold it
+    BOOST_CHECK_EQUAL(snapshot->entries[grandchild].mod_fees_with_ancestors, 7000);
+
+    {
+        LOCK2(cs_main, pool.cs);
+        pool.removeRecursive(CTransaction(tx_child[1]));
+    }
+    auto removed = pool.GetSnapshot(1000000);
+    BOOST_CHECK_EQUAL(removed->entries.size(), 2U);
+    BOOST_CHECK_EQUAL(removed->Find(tx_grandchild.GetHash()), -1);
+    BOOST_CHECK_EQUAL(removed->entries[removed->Find(tx_parent.GetHash())].children.size(), 1U);
+
+    // It is also replaced after some time, for the minimum fee to decay
+    SetMockTime(GetTime() + MEMPOOL_SNAPSHOT_MAX_AGE);
+    BOOST_CHECK(pool.GetSnapshot(1000000) != removed);
+    SetMockTime(0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -38,12 +38,27 @@ private:
 
 static CFeeRate blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
 
-static BlockAssembler AssemblerForTest(const CChainParams& params) {
+static BlockAssembler::Options OptionsForTest() {
     BlockAssembler::Options options;
 
     options.nBlockMaxWeight = MAX_BLOCK_WEIGHT;
     options.blockMinFeeRate = blockMinFeeRate;
-    return BlockAssembler(params, options);
+    return options;
+}
+
+static BlockAssembler AssemblerForTest(const CChainParams& params) {
+    return BlockAssembler(params, OptionsForTest());
+}
+
+// The incremental builder must arrive at the same block as a full selection
+static void CheckTemplateBuilder(BlockTemplateBuilder& builder, const CScript& scriptPubKey, const CBlockTemplate& expected)
+{
+    std::unique_ptr<CBlockTemplate> pblocktemplate = builder.CreateNewBlock(scriptPubKey);
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), expected.block.vtx.size());
+    for (size_t i = 1; i < expected.block.vtx.size(); ++i) {
+        BOOST_CHECK_EQUAL(pblocktemplate->block.vtx[i]->GetHash(), expected.block.vtx[i]->GetHash());
+    }
+    BOOST_CHECK(pblocktemplate->vTxFees == expected.vTxFees);
 }
 
 static
@@ -102,6 +117,8 @@ static void TestPackageSelection(const CChainParams& chainparams, const CScript&
 {
     // Test the ancestor feerate transaction selection.
     TestMemPoolEntryHelper entry;
+    BlockTemplateBuilder builder(chainparams, OptionsForTest());
+    builder.CreateNewBlock(scriptPubKey);
 
     // Test that a medium fee transaction will be selected after a higher fee
     // rate package with a low fee rate parent.
@@ -129,6 +146,7 @@ static void TestPackageSelection(const CChainParams& chainparams, const CScript&
     mempool.addUnchecked(entry.Fee(50000).Time(GetTime()).SpendsCoinbase(false).FromTx(tx));
 
     std::unique_ptr<CBlockTemplate> pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    CheckTemplateBuilder(builder, scriptPubKey, *pblocktemplate);
     BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashParentTx);
     BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == hashHighFeeTx);
     BOOST_CHECK(pblocktemplate->block.vtx[3]->GetHash() == hashMediumFeeTx);
@@ -149,6 +167,7 @@ static void TestPackageSelection(const CChainParams& chainparams, const CScript&
     uint256 hashLowFeeTx = tx.GetHash();
     mempool.addUnchecked(entry.Fee(feeToUse).FromTx(tx));
     pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    CheckTemplateBuilder(builder, scriptPubKey, *pblocktemplate);
     // Verify that the free tx and the low fee tx didn't get selected
     for (size_t i=0; i<pblocktemplate->block.vtx.size(); ++i) {
         BOOST_CHECK(pblocktemplate->block.vtx[i]->GetHash() != hashFreeTx);
@@ -163,6 +182,7 @@ static void TestPackageSelection(const CChainParams& chainparams, const CScript&
     hashLowFeeTx = tx.GetHash();
     mempool.addUnchecked(entry.Fee(feeToUse+2).FromTx(tx));
     pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    CheckTemplateBuilder(builder, scriptPubKey, *pblocktemplate);
     BOOST_CHECK(pblocktemplate->block.vtx[4]->GetHash() == hashFreeTx);
     BOOST_CHECK(pblocktemplate->block.vtx[5]->GetHash() == hashLowFeeTx);
 
@@ -184,6 +204,7 @@ static void TestPackageSelection(const CChainParams& chainparams, const CScript&
     uint256 hashLowFeeTx2 = tx.GetHash();
     mempool.addUnchecked(entry.Fee(feeToUse).SpendsCoinbase(false).FromTx(tx));
     pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    CheckTemplateBuilder(builder, scriptPubKey, *pblocktemplate);
 
     // Verify that this tx isn't selected.
     for (size_t i=0; i<pblocktemplate->block.vtx.size(); ++i) {
@@ -197,7 +218,24 @@ static void TestPackageSelection(const CChainParams& chainparams, const CScript&
     tx.vout[0].nValue = 100000000 - 10000; // 10k satoshi fee
     mempool.addUnchecked(entry.Fee(10000).FromTx(tx));
     pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    CheckTemplateBuilder(builder, scriptPubKey, *pblocktemplate);
     BOOST_CHECK(pblocktemplate->block.vtx[8]->GetHash() == hashLowFeeTx2);
+
+    // A transaction that outbids the whole selection goes first, so the
+    // builder has to select the block again from the start.
+    tx.vin[0].prevout.hash = txFirst[3]->GetHash();
+    tx.vin[0].prevout.n = 0;
+    tx.vout[0].nValue = 5000000000LL - 1000000;
+    uint256 hashTopFeeTx = tx.GetHash();
+    mempool.addUnchecked(entry.Fee(1000000).SpendsCoinbase(true).FromTx(tx));
+    pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    CheckTemplateBuilder(builder, scriptPubKey, *pblocktemplate);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashTopFeeTx);
+
+    // Removing a selected transaction drops it and its descendants.
+    mempool.removeRecursive(CTransaction(*pblocktemplate->block.vtx[2]));
+    pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    CheckTemplateBuilder(builder, scriptPubKey, *pblocktemplate);
 }
 
 // NOTE: These tests rely on CreateNewBlock doing its own self-validation!
@@ -302,5 +302,74 @@ BOOST_AUTO_TEST_CASE(LocalAddress_BasicLifecycle)
     BOOST_CHECK_EQUAL(IsLocal(addr), false);
 }
 
+BOOST_AUTO_TEST_CASE(recv_buffer_pool)
+{
+    CRecvBufferPool pool(3 * CRecvBufferPool::MIN_BUFFER_SIZE);
+    BOOST_CHECK_EQUAL(pool.Get(1).capacity(), 0U);
+
+    // Small buffers are not kept
+    CSerializeData small;
+    small.reserve(CRecvBufferPool::MIN_BUFFER_SIZE - 1);
+    pool.Put(std::move(small));
+    BOOST_CHECK_EQUAL(pool.GetPooledBuffers(), 0U);
+
+    CSerializeData buf1, buf2;
+    buf1.resize(CRecvBufferPool::MIN_BUFFER_SIZE);
+    buf2.reserve(2 * CRecvBufferPool::MIN_BUFFER_SIZE);
+    const size_t nBytes = buf1.capacity() + buf2.capacity();
+    const char* pbuf2 = buf2.data();
+    pool.Put(std::move(buf1));
+    pool.Put(std::move(buf2));
+    BOOST_CHECK_EQUAL(pool.GetPooledBuffers(), 2U);
+    BOOST_CHECK_EQUAL(pool.GetPooledBytes(), nBytes);
+
+    // The pool is full
+    CSerializeData buf3;
+    buf3.reserve(CRecvBufferPool::MIN_BUFFER_SIZE);
+    pool.Put(std::move(buf3));
+    BOOST_CHECK_EQUAL(pool.GetPooledBuffers(), 2U);
+
+    // Only the larger buffer fits, and it is handed out empty
+    CSerializeData buf = pool.Get(CRecvBufferPool::MIN_BUFFER_SIZE + 1);
+    BOOST_CHECK(buf.data() == pbuf2);
+    BOOST_CHECK(buf.empty());
+    BOOST_CHECK_EQUAL(pool.GetPooledBuffers(), 1U);
+    BOOST_CHECK_EQUAL(pool.Get(CRecvBufferPool::MIN_BUFFER_SIZE + 1).capacity(), 0U);
+    BOOST_CHECK(pool.Get(CRecvBufferPool::MIN_BUFFER_SIZE).capacity() >= CRecvBufferPool::MIN_BUFFER_SIZE);
+    BOOST_CHECK_EQUAL(pool.GetPooledBytes(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(netmessage_receive_in_place)
+{
+    std::vector<unsigned char> payload(300 * 1000);
+    for (size_t i = 0; i < payload.size(); i++) {
+        payload[i] = i * 7;
+    }
+    const uint256 hash = Hash(payload.begin(), payload.end());
+    CMessageHeader hdr(Params().MessageStart(), NetMsgType::BLOCK, payload.size());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CDataStream header(SER_NETWORK, INIT_PROTO_VERSION);
+    header << hdr;
+
+    CNetMessage msg(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+    // Nothing is received in place before the header is complete
+    BOOST_CHECK(msg.GetDataBuffer(1) == nullptr);
+    BOOST_CHECK_EQUAL(msg.readHeader(header.data(), header.size()), (int)header.size());
+
+    const unsigned int nChunk = 0x10000;
+    size_t nPos = 0;
+    while (char* pch = msg.GetDataBuffer(nChunk)) {
+        memcpy(pch, payload.data() + nPos, nChunk);
+        BOOST_CHECK_EQUAL(msg.readData(pch, nChunk), (int)nChunk);
+        nPos += nChunk;
+    }
+    // The remainder is smaller than a chunk, and is copied
+    BOOST_CHECK(nPos > 0 && payload.size() - nPos < nChunk);
+    BOOST_CHECK_EQUAL(msg.readData((const char*)payload.data() + nPos, payload.size() - nPos), (int)(payload.size() - nPos));
+    BOOST_CHECK(msg.complete());
+    BOOST_CHECK(msg.GetDataBuffer(1) == nullptr);
+    BOOST_CHECK(msg.GetMessageHash() == hash);
+    BOOST_CHECK(std::equal(payload.begin(), payload.end(), msg.vRecv.begin(), [](unsigned char a, char b) { return a == (unsigned char)b; }));
+}
 
 BOOST_AUTO_TEST_SUITE_END()
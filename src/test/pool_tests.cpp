@@ -0,0 +1,96 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <memusage.h>
+#include <support/allocators/pool.h>
+#include <test/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(pool_resource_blocks)
+{
+    PoolResource<64, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.ChunkSizeBytes(), 1024U);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 0U);
+
+    // Blocks are carved from a chunk, rounded up to the alignment
+    char* a = static_cast<char*>(resource.Allocate(8, 8));
+    char* b = static_cast<char*>(resource.Allocate(12, 8));
+    char* c = static_cast<char*>(resource.Allocate(8, 8));
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    BOOST_CHECK(b == a + 8);
+    BOOST_CHECK(c == b + 16);
+    BOOST_CHECK_EQUAL(resource.AllocatedBytes(), 32U);
+
+    // Freed blocks are reused for blocks of the same size only
+    resource.Deallocate(b, 12, 8);
+    BOOST_CHECK_EQUAL(resource.AllocatedBytes(), 16U);
+    BOOST_CHECK(resource.Allocate(8, 8) == c + 8);
+    BOOST_CHECK(resource.Allocate(16, 8) == b);
+    BOOST_CHECK_EQUAL(resource.AllocatedBytes(), 40U);
+
+    // Too large, or too strictly aligned, blocks bypass the pool
+    void* large = resource.Allocate(65, 8);
+    void* aligned = resource.Allocate(8, 16);
+    resource.Deallocate(large, 65, 8);
+    resource.Deallocate(aligned, 8, 16);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    BOOST_CHECK_EQUAL(resource.AllocatedBytes(), 40U);
+
+    // Filling the chunk allocates another one; the rest of the first chunk is
+    // not lost, but becomes a free block
+    char* begin = static_cast<char*>(resource.Allocate(64, 8));
+    for (int i = 0; i < 14; i++) {
+        resource.Allocate(64, 8);
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    const size_t nRemaining = 1024 - (begin + 15 * 64 - a);
+    BOOST_CHECK(nRemaining > 0 && nRemaining < 64);
+    resource.Allocate(64, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+    BOOST_CHECK(resource.Allocate(nRemaining, 8) == begin + 15 * 64);
+}
+
+BOOST_AUTO_TEST_CASE(pool_allocator_coins_map)
+{
+    CCoinsMapMemoryResource resource;
+    {
+        CCoinsMap map(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), CCoinsMap::allocator_type(&resource));
+        BOOST_CHECK_EQUAL(resource.AllocatedBytes(), 0U);
+        const uint256 hash = InsecureRand256();
+        for (uint32_t n = 0; n < 100000; n++) {
+            map.emplace(COutPoint(hash, n), CCoinsCacheEntry(Coin(CTxOut(n, CScript()), 1, false)));
+        }
+        for (uint32_t n = 0; n < 100000; n += 2) {
+            map.erase(COutPoint(hash, n));
+        }
+        for (uint32_t n = 0; n < 100000; n++) {
+            auto it = map.find(COutPoint(hash, n));
+            BOOST_CHECK_EQUAL(it != map.end(), n % 2 == 1);
+            if (it != map.end()) BOOST_CHECK_EQUAL(it->second.coin.out.nValue, n);
+        }
+
+        // Only the nodes in use are accounted for, at a fixed size per node
+        const size_t nChunks = resource.NumAllocatedChunks();
+        const size_t nNodeSize = resource.AllocatedBytes() / map.size();
+        BOOST_CHECK_EQUAL(resource.AllocatedBytes(), nNodeSize * 50000);
+        BOOST_CHECK(nNodeSize >= sizeof(CCoinsMap::value_type));
+        BOOST_CHECK(nChunks * resource.ChunkSizeBytes() >= 100000 * nNodeSize);
+        BOOST_CHECK(memusage::DynamicUsage(map) >= resource.AllocatedBytes() + map.bucket_count() * sizeof(void*));
+
+        // Erased nodes are reused
+        for (uint32_t n = 0; n < 100000; n += 2) {
+            map.emplace(COutPoint(hash, n), CCoinsCacheEntry());
+        }
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), nChunks);
+        BOOST_CHECK_EQUAL(map.size(), 100000U);
+        BOOST_CHECK_EQUAL(resource.AllocatedBytes(), nNodeSize * 100000);
+    }
+    BOOST_CHECK_EQUAL(resource.AllocatedBytes(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
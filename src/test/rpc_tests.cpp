@@ -18,6 +18,8 @@
 #include <univalue.h>
 
 #include <rpc/blockchain.h>
+#include <txdb.h>
+#include <validation.h>
 
 UniValue CallRPC(std::string args)
 {
@@ -417,4 +419,65 @@ BOOST_AUTO_TEST_CASE(rpc_getblockstats_calculate_percentiles_by_weight)
     }
 }
 
+BOOST_AUTO_TEST_CASE(rpc_scantxoutset_matcher)
+{
+    std::vector<CScript> scripts;
+    for (int i = 0; i < 1000; ++i) {
+        scripts.push_back(CScript() << OP_DUP << OP_HASH160 << ToByteVector(InsecureRand256()) << OP_EQUALVERIFY << OP_CHECKSIG);
+    }
+    const ScriptPubKeyMatcher matcher(scripts);
+    BOOST_CHECK_EQUAL(matcher.size(), scripts.size());
+    for (const CScript& script : scripts) {
+        BOOST_CHECK(matcher.Contains(script));
+    }
+    for (int i = 0; i < 1000; ++i) {
+        BOOST_CHECK(!matcher.Contains(CScript() << OP_DUP << OP_HASH160 << ToByteVector(InsecureRand256()) << OP_EQUALVERIFY << OP_CHECKSIG));
+    }
+    BOOST_CHECK(!ScriptPubKeyMatcher({}).Contains(scripts[0]));
+}
+
+BOOST_AUTO_TEST_CASE(rpc_scantxoutset_threads)
+{
+    // Spread coins over many ranges of transaction hashes, every tenth with a script that is searched for.
+    std::vector<CScript> needles;
+    std::map<COutPoint, Coin> expected;
+    {
+        LOCK(cs_main);
+        for (int i = 0; i < 2000; ++i) {
+            CScript script = CScript() << ToByteVector(InsecureRand256()) << OP_EQUAL;
+            COutPoint outpoint(InsecureRand256(), InsecureRandRange(3));
+            Coin coin(CTxOut(InsecureRandRange(1000) + 1, script), 1, false);
+            if (i % 10 == 0) {
+                needles.push_back(script);
+                expected.emplace(outpoint, coin);
+            }
+            pcoinsTip->AddCoin(outpoint, std::move(coin), false);
+        }
+    }
+    ::ChainstateActive().ForceFlushStateToDisk();
+    const ScriptPubKeyMatcher matcher(needles);
+
+    for (int threads : {1, 3, 16}) {
+        std::atomic<int> progress{0};
+        std::atomic<bool> abort{false};
+        int64_t count;
+        std::map<COutPoint, Coin> results;
+        BOOST_REQUIRE(FindScriptPubKey(progress, abort, count, *pcoinsdbview, matcher, results, threads));
+        BOOST_CHECK_EQUAL(progress, 100);
+        BOOST_CHECK_EQUAL(count, 2000);
+        BOOST_REQUIRE_EQUAL(results.size(), expected.size());
+        for (const auto& result : results) {
+            BOOST_CHECK(expected.count(result.first));
+            BOOST_CHECK(result.second.out == expected.at(result.first).out);
+        }
+    }
+
+    // An aborted scan stops early and reports failure.
+    std::atomic<int> progress{0};
+    std::atomic<bool> abort{true};
+    int64_t count;
+    std::map<COutPoint, Coin> results;
+    BOOST_CHECK(!FindScriptPubKey(progress, abort, count, *pcoinsdbview, matcher, results, 4));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -113,6 +113,41 @@ BOOST_AUTO_TEST_CASE(streams_vector_reader)
     BOOST_CHECK_THROW(new_reader >> d, std::ios_base::failure);
 }
 
+BOOST_AUTO_TEST_CASE(streams_span_reader)
+{
+    const std::vector<unsigned char> vch = {1, 255, 3, 4, 5, 6};
+
+    SpanReader reader(SER_NETWORK, INIT_PROTO_VERSION, MakeSpan(vch));
+    BOOST_CHECK_EQUAL(reader.size(), 6);
+    BOOST_CHECK(!reader.empty());
+
+    unsigned char a;
+    reader >> a;
+    BOOST_CHECK_EQUAL(a, 1);
+    BOOST_CHECK_EQUAL(reader.size(), 5);
+
+    // Skipping bytes does not read them.
+    reader.ignore(1);
+    BOOST_CHECK_EQUAL(reader.size(), 4);
+
+    unsigned int c;
+    reader >> c;
+    BOOST_CHECK_EQUAL(c, 100992003); // 3,4,5,6 in little-endian base-256
+    BOOST_CHECK(reader.empty());
+
+    // Reading or skipping after the end of the span throws an error.
+    BOOST_CHECK_THROW(reader >> a, std::ios_base::failure);
+    BOOST_CHECK_THROW(reader.ignore(1), std::ios_base::failure);
+
+    // The reader only sees the bytes of the span it was given.
+    SpanReader sub_reader(SER_NETWORK, INIT_PROTO_VERSION, MakeSpan(vch).subspan(1, 2));
+    signed char b;
+    sub_reader >> b;
+    BOOST_CHECK_EQUAL(b, -1);
+    BOOST_CHECK_EQUAL(sub_reader.size(), 1);
+    BOOST_CHECK_THROW(sub_reader >> c, std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_CASE(bitstream_reader_writer)
 {
     CDataStream data(SER_NETWORK, INIT_PROTO_VERSION);
@@ -6,13 +6,40 @@
 #include <txmempool.h>
 #include <amount.h>
 #include <consensus/validation.h>
+#include <fs.h>
 #include <primitives/transaction.h>
+#include <script/interpreter.h>
 #include <script/script.h>
 #include <test/setup_common.h>
 
 #include <boost/test/unit_test.hpp>
 
 
+namespace {
+
+//! Spend a pay-to-pubkey output of key to new outputs of the same key.
+CMutableTransaction SpendToKey(const CKey& key, const COutPoint& prevout, CAmount value, size_t num_outputs = 1)
+{
+    const CScript script_pub_key = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction tx;
+    tx.nVersion = 1;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vout.resize(num_outputs);
+    for (CTxOut& out : tx.vout) {
+        out.nValue = value;
+        out.scriptPubKey = script_pub_key;
+    }
+    std::vector<unsigned char> sig;
+    uint256 hash = SignatureHash(script_pub_key, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_REQUIRE(key.Sign(hash, sig));
+    sig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << sig;
+    return tx;
+}
+
+} // namespace
+
 BOOST_AUTO_TEST_SUITE(txvalidation_tests)
 
 /**
@@ -55,4 +82,119 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_reject_coinbase, TestChain100Setup)
     BOOST_CHECK(state.GetReason() == ValidationInvalidReason::CONSENSUS);
 }
 
+/**
+ * Ensure that a batch of transactions is accepted in order, with the same
+ * results as accepting them one by one.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_accept_batch, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    auto spend = [&](const COutPoint& prevout, CAmount value, size_t num_outputs = 1) {
+        return SpendToKey(coinbaseKey, prevout, value, num_outputs);
+    };
+
+    // Only the first coinbase is mature, so split it up first
+    const CTransactionRef funding = MakeTransactionRef(spend(COutPoint(m_coinbase_txns[0]->GetHash(), 0), 10 * COIN, 4));
+    LOCK(cs_main);
+    CValidationState state;
+    BOOST_REQUIRE(AcceptToMemoryPool(mempool, state, funding, nullptr /* pfMissingInputs */, nullptr /* plTxnReplaced */,
+                                     false /* bypass_limits */, 0 /* nAbsurdFee */));
+
+    std::vector<CTransactionRef> txs;
+    txs.push_back(MakeTransactionRef(spend(COutPoint(funding->GetHash(), 0), 9 * COIN)));
+    // Spends the output of the previous transaction in the batch
+    txs.push_back(MakeTransactionRef(spend(COutPoint(txs[0]->GetHash(), 0), 8 * COIN)));
+    // Invalid signature
+    CMutableTransaction bad_sig = spend(COutPoint(funding->GetHash(), 1), 9 * COIN);
+    bad_sig.vout[0].nValue = 8 * COIN;
+    txs.push_back(MakeTransactionRef(bad_sig));
+    txs.push_back(MakeTransactionRef(spend(COutPoint(funding->GetHash(), 2), 9 * COIN)));
+    // Double spend of the first transaction's input
+    txs.push_back(MakeTransactionRef(spend(COutPoint(funding->GetHash(), 0), 7 * COIN)));
+    // Spends an unknown output
+    txs.push_back(MakeTransactionRef(spend(COutPoint(InsecureRand256(), 0), 1 * COIN)));
+
+    std::vector<CValidationState> states;
+    std::vector<bool> missing_inputs;
+    std::vector<bool> accepted = AcceptToMemoryPoolBatch(mempool, states, txs, &missing_inputs, nullptr /* plTxnReplaced */,
+                                                         false /* bypass_limits */, 0 /* nAbsurdFee */);
+    BOOST_REQUIRE_EQUAL(accepted.size(), txs.size());
+    BOOST_REQUIRE_EQUAL(states.size(), txs.size());
+    BOOST_REQUIRE_EQUAL(missing_inputs.size(), txs.size());
+    BOOST_CHECK(accepted[0] && accepted[1] && accepted[3]);
+    BOOST_CHECK(!accepted[2] && !accepted[4] && !accepted[5]);
+    BOOST_CHECK_EQUAL(mempool.size(), 4U);
+
+    BOOST_CHECK_EQUAL(states[2].GetRejectReason(), "mandatory-script-verify-flag-failed (Signature must be zero for failed CHECK(MULTI)SIG operation)");
+    BOOST_CHECK_EQUAL(states[4].GetRejectReason(), "txn-mempool-conflict");
+    BOOST_CHECK(!states[5].IsInvalid());
+    BOOST_CHECK(missing_inputs[5]);
+    BOOST_CHECK(!missing_inputs[0] && !missing_inputs[2]);
+}
+
+BOOST_FIXTURE_TEST_CASE(mempool_dump_load, TestChain100Setup)
+{
+    const CTransactionRef parent = MakeTransactionRef(SpendToKey(coinbaseKey, COutPoint(m_coinbase_txns[0]->GetHash(), 0), 10 * COIN, 2));
+    const CTransactionRef child = MakeTransactionRef(SpendToKey(coinbaseKey, COutPoint(parent->GetHash(), 0), 9 * COIN));
+    const CTransactionRef grandchild = MakeTransactionRef(SpendToKey(coinbaseKey, COutPoint(child->GetHash(), 0), 8 * COIN));
+    const uint256 absent_txid = InsecureRand256();
+    {
+        LOCK(cs_main);
+        for (const CTransactionRef& tx : {parent, child, grandchild}) {
+            CValidationState state;
+            BOOST_REQUIRE(AcceptToMemoryPool(mempool, state, tx, nullptr /* pfMissingInputs */, nullptr /* plTxnReplaced */,
+                                             false /* bypass_limits */, 0 /* nAbsurdFee */));
+        }
+    }
+    mempool.PrioritiseTransaction(child->GetHash(), 1000);
+    mempool.PrioritiseTransaction(absent_txid, 2000);
+
+    BOOST_REQUIRE(DumpMempool(mempool));
+    auto reset_mempool = [&] {
+        LOCK(mempool.cs);
+        mempool.clear();
+        mempool.ClearPrioritisation(child->GetHash());
+        mempool.ClearPrioritisation(absent_txid);
+    };
+
+    // Reload at the same tip, without verifying scripts again
+    reset_mempool();
+    BOOST_REQUIRE(LoadMempool(mempool));
+    BOOST_CHECK_EQUAL(mempool.size(), 3U);
+    BOOST_CHECK(mempool.exists(grandchild->GetHash()));
+    {
+        LOCK(mempool.cs);
+        CAmount delta = 0;
+        mempool.ApplyDelta(child->GetHash(), delta);
+        BOOST_CHECK_EQUAL(delta, 1000);
+        delta = 0;
+        mempool.ApplyDelta(absent_txid, delta);
+        BOOST_CHECK_EQUAL(delta, 2000);
+    }
+
+    // Reload at another tip, which verifies the scripts again
+    BOOST_REQUIRE(DumpMempool(mempool));
+    reset_mempool();
+    CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    BOOST_REQUIRE(LoadMempool(mempool));
+    BOOST_CHECK_EQUAL(mempool.size(), 3U);
+
+    // A corrupted chunk is not loaded
+    BOOST_REQUIRE(DumpMempool(mempool));
+    reset_mempool();
+    const fs::path path = GetDataDir() / "mempool.dat";
+    std::vector<unsigned char> data(fs::file_size(path));
+    {
+        fsbridge::ifstream file(path, std::ios::binary);
+        file.read((char*)data.data(), data.size());
+    }
+    data[data.size() / 2] ^= 1;
+    {
+        fsbridge::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write((const char*)data.data(), data.size());
+    }
+    BOOST_CHECK(!LoadMempool(mempool));
+    BOOST_CHECK_EQUAL(mempool.size(), 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
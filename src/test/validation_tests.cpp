@@ -4,6 +4,8 @@
 
 #include <chainparams.h>
 #include <net.h>
+#include <streams.h>
+#include <txdb.h>
 #include <validation.h>
 
 #include <test/setup_common.h>
@@ -74,4 +76,93 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+BOOST_AUTO_TEST_CASE(strip_raw_block_witness)
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.nTime = 1231006505;
+    for (int i = 0; i < 4; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(i + 1);
+        for (CTxIn& txin : tx.vin) {
+            txin.prevout = COutPoint(InsecureRand256(), InsecureRandRange(4));
+            txin.scriptSig = CScript() << std::vector<unsigned char>(InsecureRandRange(100), 0x11);
+            // Every other transaction has witness data, on some of its inputs.
+            if (i % 2 && InsecureRandBool()) {
+                txin.scriptWitness.stack.resize(InsecureRandRange(3) + 1, std::vector<unsigned char>(InsecureRandRange(80), 0x22));
+            }
+        }
+        if (i % 2) tx.vin[0].scriptWitness.stack.resize(1);
+        tx.vout.resize(i + 2);
+        for (CTxOut& txout : tx.vout) {
+            txout.nValue = InsecureRandRange(1000);
+            txout.scriptPubKey = CScript() << OP_RETURN << std::vector<unsigned char>(InsecureRandRange(40), 0x33);
+        }
+        tx.nLockTime = i;
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+    CDataStream ss_stripped(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+    ss_stripped << block;
+
+    std::vector<uint8_t> raw(ss.begin(), ss.end());
+    const std::vector<uint8_t> raw_full(raw);
+    BOOST_CHECK(StripRawBlockWitness(raw));
+    BOOST_CHECK(raw == std::vector<uint8_t>(ss_stripped.begin(), ss_stripped.end()));
+
+    // Stripping is a no-op without witness data.
+    const std::vector<uint8_t> raw_stripped(raw);
+    BOOST_CHECK(StripRawBlockWitness(raw));
+    BOOST_CHECK(raw == raw_stripped);
+
+    // Truncated or extended blocks cannot be parsed.
+    raw = raw_full;
+    raw.pop_back();
+    BOOST_CHECK(!StripRawBlockWitness(raw));
+    raw = raw_full;
+    raw.push_back(0);
+    BOOST_CHECK(!StripRawBlockWitness(raw));
+}
+
+BOOST_FIXTURE_TEST_CASE(load_block_index_threads, TestChain100Setup)
+{
+    ::ChainstateActive().ForceFlushStateToDisk();
+
+    // Reading the block index on any number of threads gives the same result.
+    for (int n_threads : {1, 2, 7}) {
+        CBlockIndexArena arena;
+        std::map<uint256, CBlockIndex*> block_index;
+        auto insert = [&](const uint256& hash) -> CBlockIndex* {
+            if (hash.IsNull()) return nullptr;
+            auto it = block_index.emplace(hash, nullptr).first;
+            if (!it->second) {
+                it->second = arena.New();
+                it->second->phashBlock = &it->first;
+            }
+            return it->second;
+        };
+        BOOST_REQUIRE(pblocktree->LoadBlockIndexGuts(Params().GetConsensus(), insert, n_threads));
+
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(block_index.size(), ::mapBlockIndex.size());
+        BOOST_CHECK_EQUAL(arena.size(), block_index.size());
+        for (const auto& entry : ::mapBlockIndex) {
+            const CBlockIndex* expected = entry.second;
+            auto it = block_index.find(entry.first);
+            BOOST_REQUIRE(it != block_index.end());
+            const CBlockIndex* loaded = it->second;
+            BOOST_CHECK_EQUAL(loaded->GetBlockHash(), entry.first);
+            BOOST_CHECK_EQUAL(loaded->nHeight, expected->nHeight);
+            BOOST_CHECK_EQUAL(loaded->nStatus, expected->nStatus);
+            BOOST_CHECK_EQUAL(loaded->nTx, expected->nTx);
+            BOOST_CHECK_EQUAL(loaded->nFile, expected->nFile);
+            BOOST_CHECK_EQUAL(loaded->nDataPos, expected->nDataPos);
+            BOOST_CHECK_EQUAL(loaded->pprev ? loaded->pprev->GetBlockHash() : uint256(),
+                              expected->pprev ? expected->pprev->GetBlockHash() : uint256());
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
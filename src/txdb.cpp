@@ -10,14 +10,21 @@
 #include <shutdown.h>
 #include <uint256.h>
 #include <util/system.h>
+#include <util/threadnames.h>
 #include <ui_interface.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
 #include <stdint.h>
+#include <thread>
 
 #include <boost/thread.hpp>
 
 static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
+static const char DB_TX_COINS = 'T';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_BLOCK_INDEX = 'b';
 
@@ -49,17 +56,141 @@ struct CoinEntry {
     }
 };
 
+//! Key of the unspent outputs of a transaction, in the grouped layout.
+struct TxCoinsEntry {
+    uint256* hash;
+    char key;
+    explicit TxCoinsEntry(const uint256* ptr) : hash(const_cast<uint256*>(ptr)), key(DB_TX_COINS) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        s << key;
+        s << *hash;
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> key;
+        s >> *hash;
+    }
+};
+
+/**
+ * The unspent outputs of a transaction, in the grouped layout.
+ *
+ * Serialized as the number of outputs, followed by each output as the gap
+ * between its index and the previous one (VARINT), and the Coin itself.
+ */
+struct TxCoins {
+    std::map<uint32_t, Coin> outputs;
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        WriteCompactSize(s, outputs.size());
+        uint32_t next = 0;
+        for (const auto& output : outputs) {
+            s << VARINT(output.first - next);
+            s << output.second;
+            next = output.first + 1;
+        }
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        outputs.clear();
+        uint64_t count = ReadCompactSize(s);
+        uint32_t next = 0;
+        for (uint64_t i = 0; i < count; i++) {
+            uint32_t gap;
+            s >> VARINT(gap);
+            s >> outputs[next + gap];
+            next += gap + 1;
+        }
+    }
+};
+
+/** Cursor over a CCoinsViewDB in the grouped layout, that returns the outputs one by one. */
+class CCoinsViewDBGroupedCursor : public CCoinsViewCursor
+{
+    std::unique_ptr<CDBIterator> pcursor;
+    uint256 hashTx;
+    TxCoins coins;
+    std::map<uint32_t, Coin>::const_iterator itOutput;
+    //! Whether the current record could not be parsed; it is then returned as a single output without a value.
+    bool fCorrupt = false;
+
+    //! Load the transaction the database cursor points at, if any.
+    void Load()
+    {
+        coins.outputs.clear();
+        itOutput = coins.outputs.end();
+        TxCoinsEntry entry(&hashTx);
+        if (!pcursor->Valid() || !pcursor->GetKey(entry) || entry.key != DB_TX_COINS) return;
+        fCorrupt = !pcursor->GetValue(coins) || coins.outputs.empty();
+        if (fCorrupt) coins.outputs.emplace(0, Coin());
+        itOutput = coins.outputs.begin();
+    }
+
+public:
+    CCoinsViewDBGroupedCursor(CDBIterator* pcursorIn, const uint256& hashBlockIn, const uint256& hashStart = uint256()) : CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn)
+    {
+        pcursor->Seek(std::make_pair(DB_TX_COINS, hashStart));
+        Load();
+    }
+
+    bool GetKey(COutPoint& key) const override
+    {
+        if (!Valid()) return false;
+        key = COutPoint(hashTx, itOutput->first);
+        return true;
+    }
+
+    bool GetValue(Coin& coin) const override
+    {
+        if (!Valid() || fCorrupt) return false;
+        coin = itOutput->second;
+        return true;
+    }
+
+    unsigned int GetValueSize() const override
+    {
+        return Valid() ? ::GetSerializeSize(itOutput->second, CLIENT_VERSION) : 0;
+    }
+
+    bool Valid() const override { return itOutput != coins.outputs.end(); }
+
+    void Next() override
+    {
+        if (++itOutput == coins.outputs.end()) {
+            pcursor->Next();
+            Load();
+        }
+    }
+};
+
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true)
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe, bool fGroupedIn) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, "chainstate"), fGrouped(fGroupedIn)
 {
 }
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    if (fGrouped) {
+        TxCoins coins;
+        if (!db.Read(TxCoinsEntry(&outpoint.hash), coins)) return false;
+        auto it = coins.outputs.find(outpoint.n);
+        if (it == coins.outputs.end()) return false;
+        coin = std::move(it->second);
+        return true;
+    }
     return db.Read(CoinEntry(&outpoint), coin);
 }
 
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    if (fGrouped) {
+        Coin coin;
+        return GetCoin(outpoint, coin);
+    }
     return db.Exists(CoinEntry(&outpoint));
 }
 
@@ -78,7 +209,7 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -103,18 +234,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
 
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
-        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            CoinEntry entry(&it->first);
-            if (it->second.coin.IsSpent())
-                batch.Erase(entry);
-            else
-                batch.Write(entry, it->second.coin);
-            changed++;
-        }
-        count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+    auto write_partial = [&]() {
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -127,6 +247,54 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
                 }
             }
         }
+    };
+
+    // In the grouped layout, the changes are collected per transaction first,
+    // so that every transaction is read and written only once.
+    std::map<uint256, std::vector<std::pair<uint32_t, Coin>>> mapTxChanges;
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            if (fGrouped) {
+                mapTxChanges[it->first.hash].emplace_back(it->first.n, erase ? std::move(it->second.coin) : it->second.coin);
+            } else {
+                CoinEntry entry(&it->first);
+                if (it->second.coin.IsSpent())
+                    batch.Erase(entry);
+                else
+                    batch.Write(entry, it->second.coin);
+            }
+            changed++;
+        }
+        count++;
+        if (erase) {
+            it = mapCoins.erase(it);
+        } else {
+            ++it;
+        }
+        write_partial();
+    }
+
+    for (auto& tx : mapTxChanges) {
+        // Applying the changes again after an interrupted write gives the
+        // same result, which ReplayBlocks relies on.
+        TxCoinsEntry entry(&tx.first);
+        TxCoins coins;
+        if (!db.Read(entry, coins) && db.Exists(entry)) {
+            return error("%s: cannot parse coins of transaction %s", __func__, tx.first.ToString());
+        }
+        for (auto& change : tx.second) {
+            if (change.second.IsSpent()) {
+                coins.outputs.erase(change.first);
+            } else {
+                coins.outputs[change.first] = std::move(change.second);
+            }
+        }
+        if (coins.outputs.empty()) {
+            batch.Erase(entry);
+        } else {
+            batch.Write(entry, coins);
+        }
+        write_partial();
     }
 
     // In the last batch, mark the database as consistent with hashBlock again.
@@ -141,10 +309,11 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
 
 size_t CCoinsViewDB::EstimateSize() const
 {
-    return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
+    const char key = fGrouped ? DB_TX_COINS : DB_COIN;
+    return db.EstimateSize(key, (char)(key+1));
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(gArgs.IsArgSet("-blocksdir") ? GetDataDir() / "blocks" / "index" : GetBlocksDir() / "index", nCacheSize, fMemory, fWipe) {
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(gArgs.IsArgSet("-blocksdir") ? GetDataDir() / "blocks" / "index" : GetBlocksDir() / "index", nCacheSize, fMemory, fWipe, false, "blockindex") {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -168,20 +337,54 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
-    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
+    if (fGrouped) {
+        return new CCoinsViewDBGroupedCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
+    }
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
-    i->pcursor->Seek(DB_COIN);
+    return new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
+}
+
+std::vector<std::unique_ptr<CCoinsViewCursor>> CCoinsViewDB::Cursors(const std::vector<uint256>& starts) const
+{
+    CDBSnapshot snapshot = db.GetSnapshot();
+
+    // The best block has to be read from the snapshot as well.
+    uint256 hashBestChain;
+    {
+        std::unique_ptr<CDBIterator> pcursor(const_cast<CDBWrapper&>(db).NewIterator(snapshot));
+        pcursor->Seek(DB_BEST_BLOCK);
+        char key;
+        if (pcursor->Valid() && pcursor->GetKey(key) && key == DB_BEST_BLOCK) {
+            pcursor->GetValue(hashBestChain);
+        }
+    }
+
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors;
+    for (const uint256& hashStart : starts) {
+        CDBIterator* pcursor = const_cast<CDBWrapper&>(db).NewIterator(snapshot);
+        if (fGrouped) {
+            cursors.emplace_back(new CCoinsViewDBGroupedCursor(pcursor, hashBestChain, hashStart));
+        } else {
+            cursors.emplace_back(new CCoinsViewDBCursor(pcursor, hashBestChain, hashStart));
+        }
+    }
+    return cursors;
+}
+
+CCoinsViewDBCursor::CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn, const uint256 &hashStart) :
+    CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn)
+{
+    pcursor->Seek(std::make_pair(DB_COIN, hashStart));
     // Cache key of first record
-    if (i->pcursor->Valid()) {
-        CoinEntry entry(&i->keyTmp.second);
-        i->pcursor->GetKey(entry);
-        i->keyTmp.first = entry.key;
+    if (pcursor->Valid()) {
+        CoinEntry entry(&keyTmp.second);
+        pcursor->GetKey(entry);
+        keyTmp.first = entry.key;
     } else {
-        i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
+        keyTmp.first = 0; // Make sure Valid() and GetKey() return false
     }
-    return i;
 }
 
 bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
@@ -244,48 +447,123 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
-{
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+//! Number of ranges the block index is read in; the first byte of the block hash selects the range.
+static const int BLOCK_INDEX_PARTITIONS = 256;
 
-    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
+namespace {
 
-    // Load mapBlockIndex
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        if (ShutdownRequested()) return false;
+//! Entries read from one range of the block index
+struct BlockIndexPartition {
+    std::vector<std::pair<uint256, CDiskBlockIndex>> entries;
+    bool fDone = false;
+    bool fOk = false;
+};
+
+} // namespace
+
+//! Read the entries of the block index whose hash starts with the byte nPartition, and check their proof of work.
+static bool ReadBlockIndexPartition(CDBIterator& cursor, int nPartition, const Consensus::Params& consensusParams, BlockIndexPartition& partition, const std::atomic<bool>& fAbort)
+{
+    uint256 start;
+    *start.begin() = nPartition;
+    for (cursor.Seek(std::make_pair(DB_BLOCK_INDEX, start)); cursor.Valid(); cursor.Next()) {
+        if (fAbort || ShutdownRequested()) return false;
         std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-
-                if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, consensusParams))
-                    return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
-
-                pcursor->Next();
-            } else {
-                return error("%s: failed to read value", __func__);
+        if (!cursor.GetKey(key) || key.first != DB_BLOCK_INDEX || *key.second.begin() != nPartition) break;
+        CDiskBlockIndex diskindex;
+        if (!cursor.GetValue(diskindex)) {
+            return error("%s: failed to read value", __func__);
+        }
+        // Hashing the header is the bulk of the work, so do it here rather than when inserting.
+        const uint256 hash = diskindex.GetBlockHash();
+        if (!CheckProofOfWork(hash, diskindex.nBits, consensusParams))
+            return error("%s: CheckProofOfWork failed: %s", __func__, diskindex.ToString());
+        partition.entries.emplace_back(hash, std::move(diskindex));
+    }
+    return true;
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, int nThreads)
+{
+    nThreads = std::max(1, std::min(nThreads, BLOCK_INDEX_PARTITIONS));
+
+    // Ranges are read and checked on nThreads threads, and inserted on this
+    // one in order, so the result does not depend on the number of threads.
+    std::vector<BlockIndexPartition> partitions(BLOCK_INDEX_PARTITIONS);
+    std::mutex mutex;
+    std::condition_variable cond;
+    int nNext = 0;
+    int nInserted = 0;
+    std::atomic<bool> fAbort{false};
+
+    auto worker = [&]() {
+        util::ThreadRename("loadblkindex");
+        std::unique_ptr<CDBIterator> pcursor(NewIterator());
+        while (true) {
+            int i;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                // Bound the memory held by ranges that are read but not inserted yet.
+                cond.wait(lock, [&] { return fAbort || nNext == BLOCK_INDEX_PARTITIONS || nNext < nInserted + 2 * nThreads; });
+                if (fAbort || nNext == BLOCK_INDEX_PARTITIONS) return;
+                i = nNext++;
             }
-        } else {
-            break;
+            bool fOk = ReadBlockIndexPartition(*pcursor, i, consensusParams, partitions[i], fAbort);
+            std::unique_lock<std::mutex> lock(mutex);
+            partitions[i].fOk = fOk;
+            partitions[i].fDone = true;
+            cond.notify_all();
         }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; ++i) {
+        threads.emplace_back(worker);
     }
 
-    return true;
+    // Load mapBlockIndex
+    bool fOk = true;
+    for (int i = 0; i < BLOCK_INDEX_PARTITIONS && fOk; ++i) {
+        BlockIndexPartition& partition = partitions[i];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&] { return partition.fDone; });
+        }
+        fOk = partition.fOk;
+        for (const auto& entry : partition.entries) {
+            if (!fOk) break;
+            const CDiskBlockIndex& diskindex = entry.second;
+            // Construct block index object
+            CBlockIndex* pindexNew = insertBlockIndex(entry.first);
+            pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nTx            = diskindex.nTx;
+        }
+        std::vector<std::pair<uint256, CDiskBlockIndex>>().swap(partition.entries);
+        if (ShutdownRequested()) fOk = false;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        nInserted = i + 1;
+        cond.notify_all();
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        fAbort = true;
+        cond.notify_all();
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    return fOk;
 }
 
 namespace {
@@ -351,7 +629,7 @@ bool CCoinsViewDB::Upgrade() {
     std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
     pcursor->Seek(std::make_pair(DB_COINS, uint256()));
     if (!pcursor->Valid()) {
-        return true;
+        return ConvertLayout();
     }
 
     int64_t count = 0;
@@ -408,5 +686,99 @@ bool CCoinsViewDB::Upgrade() {
     db.CompactRange({DB_COINS, uint256()}, key);
     uiInterface.ShowProgress("", 100, false);
     LogPrintf("[%s].\n", ShutdownRequested() ? "CANCELLED" : "DONE");
+    return !ShutdownRequested() && ConvertLayout();
+}
+
+bool CCoinsViewDB::ConvertLayout() {
+    const char key_from = fGrouped ? DB_COIN : DB_TX_COINS;
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(key_from);
+    std::pair<char, uint256> key;
+    if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != key_from) {
+        return true;
+    }
+
+    int64_t count = 0;
+    LogPrintf("Converting utxo-set database to the %s layout...\n", fGrouped ? "grouped" : "per-output");
+    LogPrintf("[0%%]..."); /* Continued */
+    uiInterface.ShowProgress(_("Converting UTXO database"), 0, true);
+    size_t batch_size = 1 << 24;
+    CDBBatch batch(db);
+    int reportDone = 0;
+    std::pair<char, uint256> prev_key = {key_from, uint256()};
+    auto write_batch = [&]() {
+        if (batch.SizeEstimate() > batch_size) {
+            db.WriteBatch(batch);
+            batch.Clear();
+            db.CompactRange(prev_key, key);
+            prev_key = key;
+        }
+    };
+    // Outputs of the transaction being grouped, when converting to the
+    // grouped layout. Batches are only written between transactions.
+    TxCoins coins;
+    uint256 hashTx;
+    bool fFirstTx = true;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested()) {
+            break;
+        }
+        if (!pcursor->GetKey(key) || key.first != key_from) {
+            break;
+        }
+        if (count++ % 256 == 0) {
+            uint32_t high = 0x100 * *key.second.begin() + *(key.second.begin() + 1);
+            int percentageDone = (int)(high * 100.0 / 65536.0 + 0.5);
+            uiInterface.ShowProgress(_("Converting UTXO database"), percentageDone, true);
+            if (reportDone < percentageDone/10) {
+                // report max. every 10% step
+                LogPrintf("[%d%%]...", percentageDone); /* Continued */
+                reportDone = percentageDone/10;
+            }
+        }
+        if (fGrouped) {
+            COutPoint outpoint;
+            CoinEntry entry(&outpoint);
+            Coin coin;
+            if (!pcursor->GetKey(entry) || !pcursor->GetValue(coin)) {
+                return error("%s: cannot parse coin record", __func__);
+            }
+            if (outpoint.hash != hashTx || fFirstTx) {
+                if (!coins.outputs.empty()) {
+                    batch.Write(TxCoinsEntry(&hashTx), coins);
+                    coins.outputs.clear();
+                    write_batch();
+                }
+                if (fFirstTx) {
+                    // An earlier, cancelled conversion may have grouped part
+                    // of the outputs of this transaction already.
+                    db.Read(TxCoinsEntry(&outpoint.hash), coins);
+                    fFirstTx = false;
+                }
+                hashTx = outpoint.hash;
+            }
+            coins.outputs[outpoint.n] = std::move(coin);
+            batch.Erase(entry);
+        } else {
+            if (!pcursor->GetValue(coins)) {
+                return error("%s: cannot parse coins record", __func__);
+            }
+            for (auto& output : coins.outputs) {
+                COutPoint outpoint(key.second, output.first);
+                batch.Write(CoinEntry(&outpoint), output.second);
+            }
+            batch.Erase(key);
+            write_batch();
+        }
+        pcursor->Next();
+    }
+    if (!coins.outputs.empty() && fGrouped) {
+        batch.Write(TxCoinsEntry(&hashTx), coins);
+    }
+    db.WriteBatch(batch);
+    db.CompactRange(std::make_pair(key_from, uint256()), key);
+    uiInterface.ShowProgress("", 100, false);
+    LogPrintf("[%s].\n", ShutdownRequested() ? "CANCELLED" : "DONE");
     return !ShutdownRequested();
 }
@@ -39,25 +39,48 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxTxIndexCache = 1024;
 //! Max memory allocated to all block filter index caches combined in MiB.
 static const int64_t max_filter_index_cache = 1024;
+//! Maximum number of threads to read the block index with
+static const int MAX_BLOCK_INDEX_LOAD_THREADS = 8;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
-
-/** CCoinsView backed by the coin database (chainstate/) */
+//! -groupcoins default
+static const bool DEFAULT_GROUP_COINS = false;
+
+/**
+ * CCoinsView backed by the coin database (chainstate/)
+ *
+ * Coins are either stored one per key, or grouped: all unspent outputs of a
+ * transaction under a single key, so the txid is stored only once. Grouping
+ * makes the database smaller, at the cost of rewriting the remaining outputs
+ * of a transaction whenever one of them changes.
+ */
 class CCoinsViewDB final : public CCoinsView
 {
 protected:
     CDBWrapper db;
+    //! Whether coins are grouped by transaction
+    const bool fGrouped;
+
+    //! Convert coins stored in the other layout to the one in use.
+    bool ConvertLayout();
 public:
-    explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool fGroupedIn = DEFAULT_GROUP_COINS);
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override;
     CCoinsViewCursor *Cursor() const override;
 
-    //! Attempt to update from an older database format. Returns whether an error occurred.
+    /**
+     * Cursors over the coins of the transactions from each of the given
+     * hashes on, which all see the same state of the database. A cursor
+     * does not stop where the range of the next one starts.
+     */
+    std::vector<std::unique_ptr<CCoinsViewCursor>> Cursors(const std::vector<uint256>& starts) const;
+
+    //! Attempt to update from an older database format or the other layout. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
 };
@@ -76,8 +99,7 @@ public:
     void Next() override;
 
 private:
-    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
-        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
+    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn, const uint256 &hashStart = uint256());
     std::unique_ptr<CDBIterator> pcursor;
     std::pair<char, COutPoint> keyTmp;
 
@@ -97,7 +119,12 @@ public:
     void ReadReindexing(bool &fReindexing);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    /**
+     * Read all entries of the block index, inserting them with insertBlockIndex.
+     * The entries are read and their proof of work checked on up to nThreads
+     * threads; insertBlockIndex is only called on the calling thread.
+     */
+    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, int nThreads = 1);
 };
 
 #endif // BITCOIN_TXDB_H
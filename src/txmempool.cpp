@@ -33,6 +33,7 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFe
     nSizeWithAncestors = GetTxSize();
     nModFeesWithAncestors = nFee;
     nSigOpCostWithAncestors = sigOpCost;
+    m_epoch = 0;
 }
 
 void CTxMemPoolEntry::UpdateFeeDelta(int64_t newFeeDelta)
@@ -52,18 +53,35 @@ size_t CTxMemPoolEntry::GetTxSize() const
     return GetVirtualTransactionSize(nTxWeight, sigOpCost);
 }
 
+CTxMemPool::EpochGuard::EpochGuard(const CTxMemPool& in) : pool(in)
+{
+    assert(!pool.m_has_epoch_guard);
+    ++pool.m_epoch;
+    pool.m_has_epoch_guard = true;
+}
+
+CTxMemPool::EpochGuard::~EpochGuard()
+{
+    // prevents stale results being used
+    ++pool.m_epoch;
+    pool.m_has_epoch_guard = false;
+}
+
 // Update the given tx for any in-mempool descendants.
 // Assumes that setMemPoolChildren is correct for the given tx and all
 // descendants.
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
 {
-    setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
+    const EpochGuard epoch(*this);
+    std::vector<txiter> stageEntries, vecAllDescendants;
+    for (txiter childEntry : GetMemPoolChildren(updateIt)) {
+        if (!visited(childEntry)) stageEntries.push_back(childEntry);
+    }
 
     while (!stageEntries.empty()) {
-        const txiter cit = *stageEntries.begin();
-        setAllDescendants.insert(cit);
-        stageEntries.erase(cit);
+        const txiter cit = stageEntries.back();
+        vecAllDescendants.push_back(cit);
+        stageEntries.pop_back();
         const setEntries &setChildren = GetMemPoolChildren(cit);
         for (txiter childEntry : setChildren) {
             cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
@@ -71,25 +89,26 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
                 // We've already calculated this one, just add the entries for this set
                 // but don't traverse again.
                 for (txiter cacheEntry : cacheIt->second) {
-                    setAllDescendants.insert(cacheEntry);
+                    if (!visited(cacheEntry)) vecAllDescendants.push_back(cacheEntry);
                 }
-            } else if (!setAllDescendants.count(childEntry)) {
+            } else if (!visited(childEntry)) {
                 // Schedule for later processing
-                stageEntries.insert(childEntry);
+                stageEntries.push_back(childEntry);
             }
         }
     }
-    // setAllDescendants now contains all in-mempool descendants of updateIt.
+    // vecAllDescendants now contains all in-mempool descendants of updateIt.
     // Update and add to cached descendant map
     int64_t modifySize = 0;
     CAmount modifyFee = 0;
     int64_t modifyCount = 0;
-    for (txiter cit : setAllDescendants) {
+    std::vector<txiter>& cached = cachedDescendants[updateIt];
+    for (txiter cit : vecAllDescendants) {
         if (!setExclude.count(cit->GetTx().GetHash())) {
             modifySize += cit->GetTxSize();
             modifyFee += cit->GetModifiedFee();
             modifyCount++;
-            cachedDescendants[updateIt].insert(cit);
+            cached.push_back(cit);
             // Update ancestor state for each descendant
             mapTx.modify(cit, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
         }
@@ -105,6 +124,7 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
 void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashesToUpdate)
 {
     LOCK(cs);
+    ++m_snapshot_sequence;
     // For each entry in vHashesToUpdate, store the set of in-mempool, but not
     // in-vHashesToUpdate transactions, so that we don't have to recalculate
     // descendants when we come across a previously seen entry.
@@ -147,7 +167,13 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
 
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */) const
 {
-    setEntries parentHashes;
+    const EpochGuard epoch(*this);
+    // Entries already in setAncestors are not walked again
+    for (txiter it : setAncestors) {
+        visited(it);
+    }
+    // Entries are marked when staged, so each one is staged at most once
+    std::vector<txiter> parentHashes;
     const CTransaction &tx = entry.GetTx();
 
     if (fSearchForParents) {
@@ -156,8 +182,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // iterate mapTx to find parents.
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             boost::optional<txiter> piter = GetIter(tx.vin[i].prevout.hash);
-            if (piter) {
-                parentHashes.insert(*piter);
+            if (piter && !visited(*piter)) {
+                parentHashes.push_back(*piter);
                 if (parentHashes.size() + 1 > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
@@ -168,16 +194,18 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        for (txiter parent : GetMemPoolParents(it)) {
+            if (!visited(parent)) parentHashes.push_back(parent);
+        }
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
 
     while (!parentHashes.empty()) {
-        txiter stageit = *parentHashes.begin();
+        txiter stageit = parentHashes.back();
 
         setAncestors.insert(stageit);
-        parentHashes.erase(stageit);
+        parentHashes.pop_back();
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
@@ -194,8 +222,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
         for (txiter phash : setMemPoolParents) {
             // If this is a new ancestor, add it.
-            if (setAncestors.count(phash) == 0) {
-                parentHashes.insert(phash);
+            if (!visited(phash)) {
+                parentHashes.push_back(phash);
             }
             if (parentHashes.size() + setAncestors.size() + 1 > limitAncestorCount) {
                 errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
@@ -395,6 +423,7 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
     UpdateEntryForAncestors(newit, setAncestors);
 
     nTransactionsUpdated++;
+    ++m_snapshot_sequence;
     totalTxSize += entry.GetTxSize();
     if (minerPolicyEstimator) {minerPolicyEstimator->processTransaction(entry, validFeeEstimate);}
 
@@ -424,6 +453,7 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
     mapLinks.erase(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
+    ++m_snapshot_sequence;
     if (minerPolicyEstimator) {minerPolicyEstimator->removeTx(hash, false);}
 }
 
@@ -435,22 +465,24 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 // can save time by not iterating over those entries.
 void CTxMemPool::CalculateDescendants(txiter entryit, setEntries& setDescendants) const
 {
-    setEntries stage;
+    const EpochGuard epoch(*this);
+    std::vector<txiter> stage;
     if (setDescendants.count(entryit) == 0) {
-        stage.insert(entryit);
+        visited(entryit);
+        stage.push_back(entryit);
     }
     // Traverse down the children of entry, only adding children that are not
     // accounted for in setDescendants already (because those children have either
     // already been walked, or will be walked in this iteration).
     while (!stage.empty()) {
-        txiter it = *stage.begin();
+        txiter it = stage.back();
         setDescendants.insert(it);
-        stage.erase(it);
+        stage.pop_back();
 
         const setEntries &setChildren = GetMemPoolChildren(it);
         for (txiter childiter : setChildren) {
-            if (!setDescendants.count(childiter)) {
-                stage.insert(childiter);
+            if (!visited(childiter) && !setDescendants.count(childiter)) {
+                stage.push_back(childiter);
             }
         }
     }
@@ -585,6 +617,7 @@ void CTxMemPool::_clear()
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
+    ++m_snapshot_sequence;
 }
 
 void CTxMemPool::clear()
@@ -837,6 +870,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
                 mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0));
             }
             ++nTransactionsUpdated;
+            ++m_snapshot_sequence;
         }
     }
     LogPrintf("PrioritiseTransaction: %s feerate += %s\n", hash.ToString(), FormatMoney(nFeeDelta));
@@ -1099,6 +1133,98 @@ void CTxMemPool::SetIsLoaded(bool loaded)
 {
     LOCK(cs);
     m_is_loaded = loaded;
+    ++m_snapshot_sequence;
+}
+
+std::shared_ptr<const MempoolSnapshot> CTxMemPool::GetSnapshot(size_t sizelimit) const
+{
+    // Readers that find the snapshot outdated wait here for the one that
+    // replaces it, instead of all copying the mempool.
+    LOCK(m_snapshot_mutex);
+    if (m_snapshot && m_snapshot->sequence == m_snapshot_sequence && GetTime() < m_snapshot->time + MEMPOOL_SNAPSHOT_MAX_AGE) {
+        return m_snapshot;
+    }
+
+    auto snapshot = std::make_shared<MempoolSnapshot>();
+    LOCK(cs);
+    snapshot->sequence = m_snapshot_sequence;
+    snapshot->time = GetTime();
+    snapshot->loaded = m_is_loaded;
+    snapshot->total_tx_size = totalTxSize;
+    snapshot->dynamic_usage = DynamicMemoryUsage();
+    snapshot->min_fee = GetMinFee(sizelimit);
+
+    const auto iters = GetSortedDepthAndScore();
+    snapshot->entries.reserve(iters.size());
+    snapshot->positions.reserve(iters.size());
+    for (const auto& it : iters) {
+        snapshot->positions.emplace(it->GetTx().GetHash(), snapshot->positions.size());
+    }
+    for (const auto& it : iters) {
+        MempoolSnapshot::Entry entry;
+        entry.tx = it->GetSharedTx();
+        entry.fee = it->GetFee();
+        entry.modified_fee = it->GetModifiedFee();
+        entry.vsize = it->GetTxSize();
+        entry.time = it->GetTime();
+        entry.height = it->GetHeight();
+        entry.count_with_descendants = it->GetCountWithDescendants();
+        entry.size_with_descendants = it->GetSizeWithDescendants();
+        entry.mod_fees_with_descendants = it->GetModFeesWithDescendants();
+        entry.count_with_ancestors = it->GetCountWithAncestors();
+        entry.size_with_ancestors = it->GetSizeWithAncestors();
+        entry.mod_fees_with_ancestors = it->GetModFeesWithAncestors();
+        for (const txiter& parent : GetMemPoolParents(it)) {
+            entry.parents.push_back(snapshot->positions.at(parent->GetTx().GetHash()));
+        }
+        snapshot->entries.push_back(std::move(entry));
+    }
+    for (size_t pos = 0; pos < snapshot->entries.size(); ++pos) {
+        for (size_t parent : snapshot->entries[pos].parents) {
+            snapshot->entries[parent].children.push_back(pos);
+        }
+    }
+
+    m_snapshot = std::move(snapshot);
+    return m_snapshot;
+}
+
+std::vector<size_t> MempoolSnapshot::GetAncestors(size_t pos) const
+{
+    std::vector<size_t> result;
+    std::vector<bool> seen(entries.size());
+    std::vector<size_t> todo{pos};
+    seen[pos] = true;
+    while (!todo.empty()) {
+        const size_t next = todo.back();
+        todo.pop_back();
+        for (size_t parent : entries[next].parents) {
+            if (seen[parent]) continue;
+            seen[parent] = true;
+            result.push_back(parent);
+            todo.push_back(parent);
+        }
+    }
+    return result;
+}
+
+std::vector<size_t> MempoolSnapshot::GetDescendants(size_t pos) const
+{
+    std::vector<size_t> result;
+    std::vector<bool> seen(entries.size());
+    std::vector<size_t> todo{pos};
+    seen[pos] = true;
+    while (!todo.empty()) {
+        const size_t next = todo.back();
+        todo.pop_back();
+        for (size_t child : entries[next].children) {
+            if (seen[child]) continue;
+            seen[child] = true;
+            result.push_back(child);
+            todo.push_back(child);
+        }
+    }
+    return result;
 }
 
 SaltedTxidHasher::SaltedTxidHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
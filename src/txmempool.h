@@ -6,9 +6,11 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <atomic>
 #include <memory>
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <utility>
 #include <string>
@@ -130,6 +132,7 @@ public:
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable uint64_t m_epoch; //!< epoch when last touched, used by graph walks in CTxMemPool
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -367,6 +370,56 @@ public:
     }
 };
 
+/**
+ * A read-only copy of the mempool, which can be read without holding
+ * CTxMemPool::cs. See CTxMemPool::GetSnapshot().
+ */
+struct MempoolSnapshot
+{
+    struct Entry {
+        CTransactionRef tx;
+        CAmount fee;
+        CAmount modified_fee;
+        size_t vsize;
+        int64_t time;
+        unsigned int height;
+        uint64_t count_with_descendants;
+        uint64_t size_with_descendants;
+        CAmount mod_fees_with_descendants;
+        uint64_t count_with_ancestors;
+        uint64_t size_with_ancestors;
+        CAmount mod_fees_with_ancestors;
+        std::vector<size_t> parents;  //!< positions of the in-mempool parents in entries
+        std::vector<size_t> children; //!< positions of the in-mempool children in entries
+    };
+
+    //! Sorted by ancestor count, so parents come before their children
+    std::vector<Entry> entries;
+    std::unordered_map<uint256, size_t, SaltedTxidHasher> positions;
+
+    uint64_t sequence;   //!< CTxMemPool change counter at the time of the copy
+    int64_t time;        //!< time of the copy
+    bool loaded;
+    uint64_t total_tx_size;
+    size_t dynamic_usage;
+    CFeeRate min_fee;
+
+    /** Returns the position of a transaction in entries, or -1 if it was not in the mempool. */
+    ptrdiff_t Find(const uint256& txid) const
+    {
+        auto it = positions.find(txid);
+        return it == positions.end() ? -1 : it->second;
+    }
+
+    /** Positions of all in-mempool ancestors of an entry, not including itself. */
+    std::vector<size_t> GetAncestors(size_t pos) const;
+    /** Positions of all in-mempool descendants of an entry, not including itself. */
+    std::vector<size_t> GetDescendants(size_t pos) const;
+};
+
+/** Maximum age in seconds of a mempool snapshot, for the minimum fee to decay */
+static const int64_t MEMPOOL_SNAPSHOT_MAX_AGE = 10;
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain transactions
  * that may be included in the next block.
@@ -457,6 +510,12 @@ private:
 
     bool m_is_loaded GUARDED_BY(cs){false};
 
+    //! Incremented on every change that is visible in a MempoolSnapshot
+    std::atomic<uint64_t> m_snapshot_sequence{0};
+
+    mutable Mutex m_snapshot_mutex;
+    mutable std::shared_ptr<const MempoolSnapshot> m_snapshot GUARDED_BY(m_snapshot_mutex);
+
 public:
 
     static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
@@ -540,7 +599,7 @@ public:
     const setEntries & GetMemPoolChildren(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
     uint64_t CalculateDescendantMaximum(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 private:
-    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
+    typedef std::map<txiter, std::vector<txiter>, CompareIteratorByHash> cacheMap;
 
     struct TxLinks {
         setEntries parents;
@@ -555,6 +614,33 @@ private:
 
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    mutable uint64_t m_epoch{0};
+    mutable bool m_has_epoch_guard{false};
+
+    /**
+     * Graph walks mark the entries they reach with the current epoch, instead
+     * of collecting them in a set to know which ones were seen already. An
+     * EpochGuard starts a new epoch for the duration of one walk; walks can
+     * not be nested.
+     */
+    class EpochGuard {
+        const CTxMemPool& pool;
+    public:
+        explicit EpochGuard(const CTxMemPool& in);
+        ~EpochGuard();
+        EpochGuard(const EpochGuard&) = delete;
+        EpochGuard& operator=(const EpochGuard&) = delete;
+    };
+
+    /** Mark an entry as reached in the current epoch. Returns whether it was marked already. */
+    bool visited(txiter it) const EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        assert(m_has_epoch_guard);
+        bool ret = it->m_epoch >= m_epoch;
+        it->m_epoch = std::max(it->m_epoch, m_epoch);
+        return ret;
+    }
+
 public:
     indirectmap<COutPoint, const CTransaction*> mapNextTx GUARDED_BY(cs);
     std::map<uint256, CAmount> mapDeltas;
@@ -704,6 +790,14 @@ public:
 
     size_t DynamicMemoryUsage() const;
 
+    /**
+     * Returns a copy of the mempool for readers that should not hold cs, such
+     * as RPC. The copy is shared by all readers until the mempool changes or
+     * it is MEMPOOL_SNAPSHOT_MAX_AGE seconds old; only then does a reader
+     * take cs to replace it. sizelimit is passed to GetMinFee().
+     */
+    std::shared_ptr<const MempoolSnapshot> GetSnapshot(size_t sizelimit) const;
+
     boost::signals2::signal<void (CTransactionRef)> NotifyEntryAdded;
     boost::signals2::signal<void (CTransactionRef, MemPoolRemovalReason)> NotifyEntryRemoved;
 
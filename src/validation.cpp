@@ -6,9 +6,12 @@
 #include <validation.h>
 
 #include <arith_uint256.h>
+#include <blockreadahead.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkqueue.h>
+#include <coinsflush.h>
+#include <coinsprefetch.h>
 #include <consensus/consensus.h>
 #include <consensus/merkle.h>
 #include <consensus/tx_check.h>
@@ -101,6 +104,10 @@ Mutex g_best_block_mutex;
 std::condition_variable g_best_block_cv;
 uint256 g_best_block;
 int nScriptCheckThreads = 0;
+int nCoinsPrefetchThreads = 0;
+int nBlockReadAhead = 0;
+bool fAsyncFlush = DEFAULT_ASYNC_FLUSH;
+bool fMmapBlockFiles = DEFAULT_MMAP_BLOCK_FILES;
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fHavePruned = false;
@@ -109,6 +116,7 @@ bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
+int nCoinCacheRetainPercent = DEFAULT_COINS_CACHE_RETAIN;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 
@@ -146,6 +154,10 @@ namespace {
 
     /** Dirty block file entries. */
     std::set<int> setDirtyFileInfo;
+
+    /** Read-only mappings of finalized block and undo files, used if fMmapBlockFiles is set. */
+    FlatFileMapCache g_block_file_mappings;
+    FlatFileMapCache g_undo_file_mappings;
 } // anon namespace
 
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator)
@@ -168,6 +180,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 std::unique_ptr<CCoinsViewDB> pcoinsdbview;
+CCoinsViewFlusher g_coins_flusher(nullptr);
 std::unique_ptr<CCoinsViewCache> pcoinsTip;
 std::unique_ptr<CBlockTreeDB> pblocktree;
 
@@ -422,10 +435,14 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationSt
  *                                for mempool acceptance. This allows the caller to optionally
  *                                remove the cache additions if the associated transaction ends
  *                                up being rejected by the mempool.
+ * @param[in]  skip_script_checks Do not verify the input scripts, because they were verified
+ *                                against the same chain tip and flags before, e.g. when the
+ *                                transaction is reloaded from mempool.dat.
  */
 static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx,
                               bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                              bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache, bool test_accept) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+                              bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache, bool test_accept,
+                              bool skip_script_checks) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     const CTransaction& tx = *ptx;
     const uint256 hash = tx.GetHash();
@@ -746,7 +763,8 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false, txdata)) {
+        const bool fScriptChecks = !skip_script_checks;
+        if (!CheckInputs(tx, state, view, fScriptChecks, scriptVerifyFlags, true, false, txdata)) {
             // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
             // need to turn both off, and compare against just turning off CLEANSTACK
             // to see if the failure is specifically due to witness validation.
@@ -777,7 +795,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         // invalid blocks (using TestBlockValidity), however allowing such
         // transactions into the mempool can be exploited as a DoS attack.
         unsigned int currentBlockScriptVerifyFlags = GetBlockScriptFlags(::ChainActive().Tip(), chainparams.GetConsensus());
-        if (!CheckInputsFromMempoolAndCache(tx, state, view, pool, currentBlockScriptVerifyFlags, true, txdata)) {
+        if (fScriptChecks && !CheckInputsFromMempoolAndCache(tx, state, view, pool, currentBlockScriptVerifyFlags, true, txdata)) {
             return error("%s: BUG! PLEASE REPORT THIS! CheckInputs failed against latest-block but not STANDARD flags %s, %s",
                     __func__, hash.ToString(), FormatStateMessage(state));
         }
@@ -826,10 +844,10 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
 /** (try to) add transaction to memory pool with a specified acceptance time **/
 static bool AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx,
                         bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                        bool bypass_limits, const CAmount nAbsurdFee, bool test_accept) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+                        bool bypass_limits, const CAmount nAbsurdFee, bool test_accept, bool skip_script_checks = false) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     std::vector<COutPoint> coins_to_uncache;
-    bool res = AcceptToMemoryPoolWorker(chainparams, pool, state, tx, pfMissingInputs, nAcceptTime, plTxnReplaced, bypass_limits, nAbsurdFee, coins_to_uncache, test_accept);
+    bool res = AcceptToMemoryPoolWorker(chainparams, pool, state, tx, pfMissingInputs, nAcceptTime, plTxnReplaced, bypass_limits, nAbsurdFee, coins_to_uncache, test_accept, skip_script_checks);
     if (!res) {
         // Remove coins that were not present in the coins cache before calling ATMPW;
         // this is to prevent memory DoS in case we receive a large number of
@@ -918,21 +936,68 @@ static bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, const CMessa
     return true;
 }
 
+/**
+ * Map the file containing the block or undo data at pos, if -mmapblockfiles
+ * is set and no more data will be written to the file, and point record at
+ * the data and the extra_size bytes following it. Returns nullptr if the data
+ * has to be read from the file instead.
+ */
+static std::shared_ptr<const FlatFileMapping> MapRecord(FlatFileMapCache& cache, const FlatFileSeq& seq, const FlatFilePos& pos, size_t extra_size, Span<const unsigned char>& record)
+{
+    if (!fMmapBlockFiles || pos.nPos < 8) {
+        return nullptr;
+    }
+    {
+        // The file currently being written to is truncated when finalized.
+        LOCK(cs_LastBlockFile);
+        if (pos.nFile >= nLastBlockFile) {
+            return nullptr;
+        }
+    }
+    std::shared_ptr<const FlatFileMapping> mapping = cache.Get(seq, pos, pos.nPos);
+    if (!mapping) {
+        return nullptr;
+    }
+    // The size of the data precedes it, after the message start.
+    const size_t record_size = ReadLE32(mapping->Data().data() + pos.nPos - 4);
+    const size_t record_end = (size_t)pos.nPos + record_size + extra_size;
+    if ((size_t)mapping->Data().size() < record_end) {
+        // Undo data for out of order blocks is appended to older files.
+        mapping = cache.Get(seq, pos, record_end);
+        if (!mapping) {
+            return nullptr;
+        }
+    }
+    record = mapping->Data().subspan(pos.nPos, record_size + extra_size);
+    return mapping;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::Params& consensusParams)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
-
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    Span<const unsigned char> record;
+    if (std::shared_ptr<const FlatFileMapping> mapping = MapRecord(g_block_file_mappings, BlockFileSeq(), pos, 0, record)) {
+        // Read block from the mapping
+        try {
+            SpanReader(SER_DISK, CLIENT_VERSION, record) >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+
+        // Read block
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
 
     // Check the header
@@ -960,6 +1025,19 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
 
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start)
 {
+    Span<const unsigned char> record;
+    if (std::shared_ptr<const FlatFileMapping> mapping = MapRecord(g_block_file_mappings, BlockFileSeq(), pos, 0, record)) {
+        if (memcmp(record.data() - 8, message_start, CMessageHeader::MESSAGE_START_SIZE)) {
+            return error("%s: Block magic mismatch for %s", __func__, pos.ToString());
+        }
+        if ((size_t)record.size() > MAX_SIZE) {
+            return error("%s: Block data is larger than maximum deserialization size for %s: %s versus %s", __func__, pos.ToString(),
+                    record.size(), MAX_SIZE);
+        }
+        block.assign(record.begin(), record.end());
+        return true;
+    }
+
     FlatFilePos hpos = pos;
     hpos.nPos -= 8; // Seek back 8 bytes for meta header
     CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
@@ -1004,6 +1082,71 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex
     return ReadRawBlockFromDisk(block, block_pos, message_start);
 }
 
+bool StripRawBlockWitness(std::vector<uint8_t>& block)
+{
+    // Walk the serialization, and move everything but the segwit marker, flag
+    // and witnesses forward over the removed parts. As data only moves
+    // towards the start, it never overwrites data that has not been read yet.
+    SpanReader s(SER_NETWORK, PROTOCOL_VERSION, Span<const uint8_t>(block.data(), block.size()));
+    size_t write_pos = 0;
+    size_t copy_start = 0;
+    const auto read_pos = [&]() { return block.size() - s.size(); };
+    const auto copy = [&](size_t copy_end) {
+        const size_t len = copy_end - copy_start;
+        if (write_pos != copy_start) memmove(block.data() + write_pos, block.data() + copy_start, len);
+        write_pos += len;
+    };
+
+    try {
+        s.ignore(80); // block header
+        const uint64_t tx_count = ReadCompactSize(s);
+        for (uint64_t i = 0; i < tx_count; i++) {
+            s.ignore(4); // nVersion
+            uint64_t vin_count = ReadCompactSize(s);
+            bool has_witness = false;
+            if (vin_count == 0) {
+                // Extended serialization: the empty input vector is the
+                // marker, followed by the flags and the real inputs.
+                const size_t marker_pos = read_pos() - 1;
+                uint8_t flags;
+                s >> flags;
+                if (flags != 1) return false;
+                copy(marker_pos);
+                copy_start = read_pos();
+                has_witness = true;
+                vin_count = ReadCompactSize(s);
+            }
+            for (uint64_t n = 0; n < vin_count; n++) {
+                s.ignore(36); // prevout
+                s.ignore(ReadCompactSize(s)); // scriptSig
+                s.ignore(4); // nSequence
+            }
+            const uint64_t vout_count = ReadCompactSize(s);
+            for (uint64_t n = 0; n < vout_count; n++) {
+                s.ignore(8); // nValue
+                s.ignore(ReadCompactSize(s)); // scriptPubKey
+            }
+            if (has_witness) {
+                copy(read_pos());
+                for (uint64_t n = 0; n < vin_count; n++) {
+                    const uint64_t stack_size = ReadCompactSize(s);
+                    for (uint64_t k = 0; k < stack_size; k++) {
+                        s.ignore(ReadCompactSize(s));
+                    }
+                }
+                copy_start = read_pos();
+            }
+            s.ignore(4); // nLockTime
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+    if (!s.empty()) return false;
+    copy(read_pos());
+    block.resize(write_pos);
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
@@ -1342,37 +1485,50 @@ static bool UndoWriteToDisk(const CBlockUndo& blockundo, FlatFilePos& pos, const
     return true;
 }
 
-bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
+/** Read and verify undo data written by UndoWriteToDisk from a stream. */
+template <typename Stream>
+static bool ReadUndoData(CBlockUndo& blockundo, Stream& filein, const CBlockIndex* pindex)
 {
-    FlatFilePos pos = pindex->GetUndoPos();
-    if (pos.IsNull()) {
-        return error("%s: no undo data available", __func__);
-    }
-
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("%s: OpenUndoFile failed", __func__);
-
     // Read block
     uint256 hashChecksum;
-    CHashVerifier<CAutoFile> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
+    CHashVerifier<Stream> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
     try {
         verifier << pindex->pprev->GetBlockHash();
         verifier >> blockundo;
         filein >> hashChecksum;
     }
     catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        return error("UndoReadFromDisk: Deserialize or I/O error - %s", e.what());
     }
 
     // Verify checksum
     if (hashChecksum != verifier.GetHash())
-        return error("%s: Checksum mismatch", __func__);
+        return error("UndoReadFromDisk: Checksum mismatch");
 
     return true;
 }
 
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    FlatFilePos pos = pindex->GetUndoPos();
+    if (pos.IsNull()) {
+        return error("%s: no undo data available", __func__);
+    }
+
+    Span<const unsigned char> record;
+    if (std::shared_ptr<const FlatFileMapping> mapping = MapRecord(g_undo_file_mappings, UndoFileSeq(), pos, sizeof(uint256), record)) {
+        SpanReader reader(SER_DISK, CLIENT_VERSION, record);
+        return ReadUndoData(blockundo, reader, pindex);
+    }
+
+    // Open history file to read
+    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenUndoFile failed", __func__);
+
+    return ReadUndoData(blockundo, filein, pindex);
+}
+
 /** Abort with a message */
 static bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -1527,6 +1683,136 @@ void ThreadScriptCheck(int worker_num) {
     scriptcheckqueue.Thread();
 }
 
+/**
+ * Verify the scripts of a batch of transactions on the script check threads,
+ * storing the signatures in the signature cache, so that accepting the
+ * transactions to the memory pool afterwards does not verify them again.
+ * Transactions that fail cheap checks or spend unknown outputs are left to
+ * the normal acceptance path. Outputs created by earlier transactions in the
+ * batch may be spent. The result of the checks is not used: a failure only
+ * means that some signatures did not make it into the cache.
+ *
+ * @param[out] coins_to_uncache   Per transaction, the outpoints that were added
+ *                                to the coins cache to look up its inputs.
+ */
+static void PreVerifyMempoolScripts(const CTxMemPool& pool, const std::vector<CTransactionRef>& txs, std::vector<std::vector<COutPoint>>& coins_to_uncache) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    coins_to_uncache.assign(txs.size(), {});
+    if (!nScriptCheckThreads || txs.size() < 2) return;
+    int64_t nTimeStart = GetTimeMicros();
+
+    // Must outlive the checks, which refer to them
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(txs.size());
+    std::vector<CScriptCheck> vChecks;
+    std::map<COutPoint, CTxOut> batch_outputs;
+    size_t nTxChecked = 0;
+    {
+        LOCK(pool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip.get(), pool);
+        CCoinsViewCache view(&viewMemPool);
+        for (size_t n = 0; n < txs.size(); ++n) {
+            const CTransaction& tx = *txs[n];
+            CValidationState state;
+            std::string reason;
+            if (!CheckTransaction(tx, state) || tx.IsCoinBase() || (fRequireStandard && !IsStandardTx(tx, reason)) || pool.exists(tx.GetHash())) {
+                continue;
+            }
+            std::vector<CTxOut> spent_outputs;
+            for (const CTxIn& txin : tx.vin) {
+                auto it = batch_outputs.find(txin.prevout);
+                if (it != batch_outputs.end()) {
+                    spent_outputs.push_back(it->second);
+                    continue;
+                }
+                if (!pcoinsTip->HaveCoinInCache(txin.prevout)) {
+                    coins_to_uncache[n].push_back(txin.prevout);
+                }
+                const Coin& coin = view.AccessCoin(txin.prevout);
+                if (coin.IsSpent()) break;
+                spent_outputs.push_back(coin.out);
+            }
+            for (size_t i = 0; i < tx.vout.size(); i++) {
+                batch_outputs.emplace(COutPoint(tx.GetHash(), i), tx.vout[i]);
+            }
+            if (spent_outputs.size() != tx.vin.size()) continue;
+
+            txdata.emplace_back(tx);
+            for (size_t i = 0; i < tx.vin.size(); i++) {
+                vChecks.emplace_back(spent_outputs[i], tx, i, STANDARD_SCRIPT_VERIFY_FLAGS, true /* cacheStore */, &txdata.back());
+            }
+            ++nTxChecked;
+        }
+    }
+
+    const size_t nChecks = vChecks.size();
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+
+    LogPrint(BCLog::BENCH, "    - Verify %u scripts of %u/%u txs for mempool: %.2fms\n", nChecks, nTxChecked, txs.size(), 0.001 * (GetTimeMicros() - nTimeStart));
+}
+
+/** (try to) add a batch of transactions to memory pool with specified acceptance times **/
+static std::vector<bool> AcceptToMemoryPoolBatchWithTime(const CChainParams& chainparams, CTxMemPool& pool, std::vector<CValidationState>& states,
+                        const std::vector<CTransactionRef>& txs, const std::vector<int64_t>& accept_times,
+                        std::vector<bool>* pvMissingInputs, std::list<CTransactionRef>* plTxnReplaced,
+                        bool bypass_limits, const CAmount nAbsurdFee, bool skip_script_checks = false) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    assert(accept_times.size() == txs.size());
+    std::vector<std::vector<COutPoint>> coins_to_uncache(txs.size());
+    if (!skip_script_checks) PreVerifyMempoolScripts(pool, txs, coins_to_uncache);
+
+    std::vector<bool> accepted(txs.size());
+    states.assign(txs.size(), CValidationState());
+    if (pvMissingInputs) pvMissingInputs->assign(txs.size(), false);
+    for (size_t i = 0; i < txs.size(); ++i) {
+        bool fMissingInputs = false;
+        accepted[i] = AcceptToMemoryPoolWithTime(chainparams, pool, states[i], txs[i], &fMissingInputs, accept_times[i],
+                                                 plTxnReplaced, bypass_limits, nAbsurdFee, false /* test_accept */, skip_script_checks);
+        if (pvMissingInputs) (*pvMissingInputs)[i] = fMissingInputs;
+    }
+    // Only the coins of rejected transactions; as in AcceptToMemoryPoolWithTime.
+    for (size_t i = 0; i < coins_to_uncache.size(); ++i) {
+        if (accepted[i]) continue;
+        for (const COutPoint& outpoint : coins_to_uncache[i]) {
+            pcoinsTip->Uncache(outpoint);
+        }
+    }
+    return accepted;
+}
+
+std::vector<bool> AcceptToMemoryPoolBatch(CTxMemPool& pool, std::vector<CValidationState>& states, const std::vector<CTransactionRef>& txs,
+                        std::vector<bool>* pvMissingInputs, std::list<CTransactionRef>* plTxnReplaced,
+                        bool bypass_limits, const CAmount nAbsurdFee)
+{
+    const std::vector<int64_t> accept_times(txs.size(), GetTime());
+    return AcceptToMemoryPoolBatchWithTime(Params(), pool, states, txs, accept_times, pvMissingInputs, plTxnReplaced, bypass_limits, nAbsurdFee);
+}
+
+static CCoinsPrefetcher coinsprefetcher(8);
+/** The block whose inputs were last queued in coinsprefetcher, if they have not been applied yet */
+static uint256 hashPrefetchedBlock GUARDED_BY(cs_main);
+
+void ThreadCoinsPrefetch(int worker_num) {
+    util::ThreadRename(strprintf("prefetch.%i", worker_num));
+    coinsprefetcher.Thread();
+}
+
+static CBlockReadAhead blockreadahead;
+
+void ThreadBlockReadAhead(int worker_num) {
+    util::ThreadRename(strprintf("readahead.%i", worker_num));
+    blockreadahead.Thread();
+}
+
+void ThreadCoinsFlush() {
+    util::ThreadRename("coinsflush");
+    if (!g_coins_flusher.Thread()) {
+        AbortNode("Failed to write to coin database");
+    }
+}
+
 VersionBitsCache versionbitscache GUARDED_BY(cs_main);
 
 int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
@@ -2036,7 +2322,19 @@ bool CChainState::FlushStateToDisk(
                 return AbortNode(state, "Disk space is low!", _("Error: Disk space is low!"));
             }
             // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
+            // When retaining, unspent coins stay cached so the working set
+            // doesn't have to be read back from disk after every flush.
+            // With -asyncflush this only hands the coins off to the writer
+            // thread; wait for it when the caller relies on them being on
+            // disk, or before pruning further.
+            bool fFlushed = nCoinCacheRetainPercent > 0 ? pcoinsTip->Sync(nTotalSpace / 100 * nCoinCacheRetainPercent) : pcoinsTip->Flush();
+            if (fFlushed && (mode == FlushStateMode::ALWAYS || fFlushForPrune)) {
+                fFlushed = g_coins_flusher.Wait();
+            }
+            // Lookups in flight may have read the database while it was being written.
+            coinsprefetcher.Discard();
+            hashPrefetchedBlock.SetNull();
+            if (!fFlushed)
                 return AbortNode(state, "Failed to write to coin database");
             nLastFlush = nNow;
             full_flush_completed = true;
@@ -2392,6 +2690,50 @@ void CChainState::PruneBlockIndexCandidates() {
     assert(!setBlockIndexCandidates.empty());
 }
 
+/**
+ * Obtain the block that is about to be connected, have the blocks following
+ * it along the chain read and checked in the background, and prefetch the
+ * inputs of the next one while this one is connected. Returns nullptr if the
+ * block could not be read, in which case ConnectTip reads it itself and
+ * reports the error.
+ */
+static std::shared_ptr<const CBlock> ReadAheadForConnect(std::vector<CBlockIndex*>::const_reverse_iterator it, std::vector<CBlockIndex*>::const_reverse_iterator end,
+    const CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, const Consensus::Params& consensusParams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    auto get_block = [&](const CBlockIndex* pindex) {
+        if (pindex == pindexMostWork && pblock) return pblock;
+        return blockreadahead.Get(pindex->GetBlockHash(), pindex->GetBlockPos(), consensusParams);
+    };
+    std::shared_ptr<const CBlock> pblockConnect = get_block(*it);
+
+    std::vector<std::pair<uint256, FlatFilePos>> vWindow;
+    const size_t nWindow = nBlockReadAhead ? nBlockReadAhead : 1;
+    for (auto itAhead = std::next(it); itAhead != end && vWindow.size() < nWindow; ++itAhead) {
+        if (*itAhead == pindexMostWork && pblock) break;
+        vWindow.emplace_back((*itAhead)->GetBlockHash(), (*itAhead)->GetBlockPos());
+    }
+    blockreadahead.SetWindow(vWindow, consensusParams);
+
+    if (nCoinsPrefetchThreads) {
+        // The inputs of this block were normally queued while the previous
+        // one was connected; this also holds when that happened in an
+        // earlier ActivateBestChainStep call.
+        if (pblockConnect && hashPrefetchedBlock != (*it)->GetBlockHash()) {
+            coinsprefetcher.Prefetch(&g_coins_flusher, *pcoinsTip, *pblockConnect);
+        }
+        coinsprefetcher.Apply(*pcoinsTip);
+        hashPrefetchedBlock.SetNull();
+        if (std::next(it) != end) {
+            std::shared_ptr<const CBlock> pblockNext = get_block(*std::next(it));
+            if (pblockNext) {
+                coinsprefetcher.Prefetch(&g_coins_flusher, *pcoinsTip, *pblockNext);
+                hashPrefetchedBlock = pblockNext->GetHash();
+            }
+        }
+    }
+    return pblockConnect;
+}
+
 /**
  * Try to make some progress towards making pindexMostWork the active block.
  * pblock is either nullptr or a pointer to a CBlock corresponding to pindexMostWork.
@@ -2434,8 +2776,15 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
         nHeight = nTargetHeight;
 
         // Connect new blocks.
-        for (CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
-            if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
+        for (auto it = vpindexToConnect.crbegin(); it != vpindexToConnect.crend(); ++it) {
+            CBlockIndex *pindexConnect = *it;
+            std::shared_ptr<const CBlock> pblockConnect;
+            if (nBlockReadAhead || nCoinsPrefetchThreads) {
+                pblockConnect = ReadAheadForConnect(it, vpindexToConnect.crend(), pindexMostWork, pblock, chainparams.GetConsensus());
+            } else if (pindexConnect == pindexMostWork) {
+                pblockConnect = pblock;
+            }
+            if (!ConnectTip(state, chainparams, pindexConnect, pblockConnect, connectTrace, disconnectpool)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (state.GetReason() != ValidationInvalidReason::BLOCK_MUTATED) {
@@ -2789,7 +3138,8 @@ CBlockIndex* CChainState::AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = m_block_index_arena.New();
+    *pindexNew = CBlockIndex(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -3543,6 +3893,8 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
         FlatFilePos pos(*it, 0);
         fs::remove(BlockFileSeq().FileName(pos));
         fs::remove(UndoFileSeq().FileName(pos));
+        g_block_file_mappings.Erase(*it);
+        g_undo_file_mappings.Erase(*it);
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
     }
 }
@@ -3688,7 +4040,7 @@ CBlockIndex * CChainState::InsertBlockIndex(const uint256& hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew = m_block_index_arena.New();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -3697,7 +4049,8 @@ CBlockIndex * CChainState::InsertBlockIndex(const uint256& hash)
 
 bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlockTreeDB& blocktree)
 {
-    if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); }))
+    if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); },
+                                      std::min(GetNumCores(), MAX_BLOCK_INDEX_LOAD_THREADS)))
         return false;
 
     // Calculate nChainWork
@@ -4191,6 +4544,8 @@ void UnloadBlockIndex()
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
     nLastBlockFile = 0;
+    g_block_file_mappings.Clear();
+    g_undo_file_mappings.Clear();
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
     versionbitscache.Clear();
@@ -4198,10 +4553,8 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
-    for (const BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    ::ChainstateActive().m_block_index_arena.Clear();
     fHavePruned = false;
 
     ::ChainstateActive().UnloadBlockIndex();
@@ -4595,8 +4948,32 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(::ChainActive().Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_CHECKSUM = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+
+//! Number of transactions from mempool.dat to accept at once
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 100;
+
+//! Maximum number of records in a checksummed chunk of mempool.dat
+static const uint64_t MEMPOOL_DUMP_CHUNK_SIZE = MEMPOOL_LOAD_BATCH_SIZE;
+
+//! Record types in a version 2 mempool.dat
+enum MempoolRecordType : uint8_t {
+    MEMPOOL_RECORD_TX = 1,    //!< transaction, acceptance time and fee delta
+    MEMPOOL_RECORD_DELTA = 2, //!< fee delta of a transaction not in the mempool
+};
 
+/**
+ * Version 2 of mempool.dat consists of:
+ * - the version, the hash of the chain tip and the standard script verification
+ *   flags when the file was written;
+ * - chunks of at most MEMPOOL_DUMP_CHUNK_SIZE records, each preceded by its
+ *   record count and followed by the hash of the file up to that point;
+ * - an empty chunk.
+ * Transactions are written in topological order. A chunk is only used after
+ * its checksum is verified. If the tip and flags are still the same when the
+ * file is loaded, the scripts of its transactions are not verified again.
+ */
 bool LoadMempool(CTxMemPool& pool)
 {
     const CChainParams& chainparams = Params();
@@ -4613,57 +4990,136 @@ bool LoadMempool(CTxMemPool& pool)
     int64_t failed = 0;
     int64_t already_there = 0;
     int64_t nNow = GetTime();
+    bool skip_script_checks = false;
+
+    // Transactions are accepted in batches, so their scripts can be verified
+    // in parallel.
+    std::vector<CTransactionRef> batch;
+    std::vector<int64_t> batch_times;
+    auto add_tx = [&](CTransactionRef tx, int64_t nTime, int64_t nFeeDelta) {
+        CAmount amountdelta = nFeeDelta;
+        if (amountdelta) {
+            pool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+        }
+        if (nTime + nExpiryTimeout > nNow) {
+            batch.push_back(std::move(tx));
+            batch_times.push_back(nTime);
+        } else {
+            ++expired;
+        }
+    };
+    auto accept_batch = [&]() {
+        LOCK(cs_main);
+        std::vector<CValidationState> states;
+        AcceptToMemoryPoolBatchWithTime(chainparams, pool, states, batch, batch_times, nullptr /* pvMissingInputs */,
+                                        nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */, skip_script_checks);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (states[i].IsValid()) {
+                ++count;
+            } else {
+                // mempool may contain the transaction already, e.g. from
+                // wallet(s) having loaded it while we were processing
+                // mempool transactions; consider these as valid, instead of
+                // failed, but mark them as 'already there'
+                if (pool.exists(batch[i]->GetHash())) {
+                    ++already_there;
+                } else {
+                    ++failed;
+                }
+            }
+        }
+        batch.clear();
+        batch_times.clear();
+    };
 
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
-            return false;
-        }
-        uint64_t num;
-        file >> num;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                pool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+        if (version == MEMPOOL_DUMP_VERSION_NO_CHECKSUM) {
+            uint64_t num;
+            file >> num;
+            while (num--) {
+                CTransactionRef tx;
+                int64_t nTime;
+                int64_t nFeeDelta;
+                file >> tx;
+                file >> nTime;
+                file >> nFeeDelta;
+                add_tx(std::move(tx), nTime, nFeeDelta);
+                if (batch.size() < MEMPOOL_LOAD_BATCH_SIZE && num) continue;
+
+                accept_batch();
+                if (ShutdownRequested())
+                    return false;
             }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
+            std::map<uint256, CAmount> mapDeltas;
+            file >> mapDeltas;
+
+            for (const auto& i : mapDeltas) {
+                pool.PrioritiseTransaction(i.first, i.second);
+            }
+        } else if (version == MEMPOOL_DUMP_VERSION) {
+            CHashVerifier<CAutoFile> verifier(&file);
+            uint256 tip_hash;
+            uint32_t script_flags;
+            verifier >> tip_hash;
+            verifier >> script_flags;
+            {
                 LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, nullptr /* pfMissingInputs */, nTime,
-                                           nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
-                                           false /* test_accept */);
-                if (state.IsValid()) {
-                    ++count;
-                } else {
-                    // mempool may contain the transaction already, e.g. from
-                    // wallet(s) having loaded it while we were processing
-                    // mempool transactions; consider these as valid, instead of
-                    // failed, but mark them as 'already there'
-                    if (pool.exists(tx->GetHash())) {
-                        ++already_there;
+                skip_script_checks = ::ChainActive().Tip() && ::ChainActive().Tip()->GetBlockHash() == tip_hash &&
+                                     script_flags == STANDARD_SCRIPT_VERIFY_FLAGS;
+            }
+            if (skip_script_checks) {
+                LogPrintf("Mempool file was written at the current tip, not verifying scripts again\n");
+            }
+
+            std::vector<std::pair<uint256, CAmount>> deltas;
+            while (true) {
+                uint64_t num = ReadCompactSize(verifier);
+                if (num == 0) break;
+                if (num > MEMPOOL_DUMP_CHUNK_SIZE) {
+                    throw std::ios_base::failure("mempool chunk too large");
+                }
+                while (num--) {
+                    uint8_t type;
+                    verifier >> type;
+                    if (type == MEMPOOL_RECORD_TX) {
+                        CTransactionRef tx;
+                        int64_t nTime;
+                        int64_t nFeeDelta;
+                        verifier >> tx;
+                        verifier >> nTime;
+                        verifier >> nFeeDelta;
+                        // Deltas are only applied once the chunk is verified
+                        if (nFeeDelta) deltas.emplace_back(tx->GetHash(), nFeeDelta);
+                        add_tx(std::move(tx), nTime, 0);
+                    } else if (type == MEMPOOL_RECORD_DELTA) {
+                        uint256 txid;
+                        CAmount delta;
+                        verifier >> txid;
+                        verifier >> delta;
+                        deltas.emplace_back(txid, delta);
                     } else {
-                        ++failed;
+                        throw std::ios_base::failure("unknown mempool record type");
                     }
                 }
-            } else {
-                ++expired;
-            }
-            if (ShutdownRequested())
-                return false;
-        }
-        std::map<uint256, CAmount> mapDeltas;
-        file >> mapDeltas;
+                const uint256 expected = CHashWriter(verifier).GetHash();
+                uint256 checksum;
+                verifier >> checksum;
+                if (checksum != expected) {
+                    throw std::ios_base::failure("mempool chunk checksum mismatch");
+                }
 
-        for (const auto& i : mapDeltas) {
-            pool.PrioritiseTransaction(i.first, i.second);
+                for (const auto& delta : deltas) {
+                    pool.PrioritiseTransaction(delta.first, delta.second);
+                }
+                deltas.clear();
+                accept_batch();
+                if (ShutdownRequested())
+                    return false;
+            }
+        } else {
+            return false;
         }
     } catch (const std::exception& e) {
         LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
@@ -4678,17 +5134,21 @@ bool DumpMempool(const CTxMemPool& pool)
 {
     int64_t start = GetTimeMicros();
 
-    std::map<uint256, CAmount> mapDeltas;
+    std::vector<std::pair<uint256, CAmount>> deltas;
     std::vector<TxMempoolInfo> vinfo;
+    uint256 tip_hash;
 
     static Mutex dump_mutex;
     LOCK(dump_mutex);
 
     {
-        LOCK(pool.cs);
+        LOCK2(cs_main, pool.cs);
+        // The mempool is consistent with the tip while both are locked
+        if (::ChainActive().Tip()) tip_hash = ::ChainActive().Tip()->GetBlockHash();
         for (const auto &i : pool.mapDeltas) {
-            mapDeltas[i.first] = i.second;
+            if (!pool.exists(i.first)) deltas.push_back(i);
         }
+        // Sorted by ancestor count, so parents come before their children
         vinfo = pool.infoAll();
     }
 
@@ -4705,15 +5165,32 @@ bool DumpMempool(const CTxMemPool& pool)
         uint64_t version = MEMPOOL_DUMP_VERSION;
         file << version;
 
-        file << (uint64_t)vinfo.size();
-        for (const auto& i : vinfo) {
-            file << *(i.tx);
-            file << (int64_t)i.nTime;
-            file << (int64_t)i.nFeeDelta;
-            mapDeltas.erase(i.tx->GetHash());
+        CHashedSourceWriter<CAutoFile> writer(&file);
+        writer << tip_hash;
+        writer << (uint32_t)STANDARD_SCRIPT_VERIFY_FLAGS;
+
+        const size_t num_records = vinfo.size() + deltas.size();
+        for (size_t pos = 0; pos < num_records;) {
+            const uint64_t num = std::min<uint64_t>(num_records - pos, MEMPOOL_DUMP_CHUNK_SIZE);
+            WriteCompactSize(writer, num);
+            for (const size_t end = pos + num; pos < end; ++pos) {
+                if (pos < vinfo.size()) {
+                    const TxMempoolInfo& info = vinfo[pos];
+                    writer << (uint8_t)MEMPOOL_RECORD_TX;
+                    writer << *(info.tx);
+                    writer << (int64_t)info.nTime;
+                    writer << (int64_t)info.nFeeDelta;
+                } else {
+                    const auto& delta = deltas[pos - vinfo.size()];
+                    writer << (uint8_t)MEMPOOL_RECORD_DELTA;
+                    writer << delta.first;
+                    writer << delta.second;
+                }
+            }
+            writer << CHashWriter(writer).GetHash();
         }
+        WriteCompactSize(writer, 0);
 
-        file << mapDeltas;
         if (!FileCommit(file.Get()))
             throw std::runtime_error("FileCommit failed");
         file.fclose();
@@ -4751,10 +5228,7 @@ class CMainCleanup
 public:
     CMainCleanup() {}
     ~CMainCleanup() {
-        // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
+        // block headers; the entries themselves are freed with their arena
         mapBlockIndex.clear();
     }
 };
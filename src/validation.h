@@ -37,6 +37,7 @@ class CBlockTreeDB;
 class CBlockUndo;
 class CChainParams;
 class CCoinsViewDB;
+class CCoinsViewFlusher;
 class CInv;
 class CConnman;
 class CScriptCheck;
@@ -78,6 +79,22 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of block input prefetching threads allowed */
+static const int MAX_COINS_PREFETCH_THREADS = 32;
+/** -prefetchthreads default (number of block input prefetching threads, 0 = disabled) */
+static const int DEFAULT_COINS_PREFETCH_THREADS = 0;
+/** Maximum number of blocks read ahead of block connection */
+static const int MAX_BLOCK_READ_AHEAD = 16;
+/** -blockreadahead default (number of blocks read and checked in the background, 0 = disabled) */
+static const int DEFAULT_BLOCK_READ_AHEAD = 0;
+/** Maximum percentage of the coins cache space kept in memory after a flush */
+static const int MAX_COINS_CACHE_RETAIN = 75;
+/** -dbcacheretain default (percentage of the coins cache space kept in memory after a flush, 0 = disabled) */
+static const int DEFAULT_COINS_CACHE_RETAIN = 0;
+/** -asyncflush default (write the UTXO database in the background) */
+static const bool DEFAULT_ASYNC_FLUSH = false;
+/** -mmapblockfiles default (read finalized block and undo files through memory mappings) */
+static const bool DEFAULT_MMAP_BLOCK_FILES = false;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -150,10 +167,15 @@ extern uint256 g_best_block;
 extern std::atomic_bool fImporting;
 extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
+extern int nCoinsPrefetchThreads;
+extern int nBlockReadAhead;
+extern bool fAsyncFlush;
+extern bool fMmapBlockFiles;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
+extern int nCoinCacheRetainPercent;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
 /** If the tip is older than this (in seconds), the node is considered to be in initial block download. */
@@ -246,6 +268,12 @@ bool LoadChainTip(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_m
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck(int worker_num);
+/** Run an instance of the block input prefetching thread */
+void ThreadCoinsPrefetch(int worker_num);
+/** Run an instance of the block read-ahead thread */
+void ThreadBlockReadAhead(int worker_num);
+/** Run the background UTXO database writer thread */
+void ThreadCoinsFlush();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransactionRef& tx, const Consensus::Params& params, uint256& hashBlock, const CBlockIndex* const blockIndex = nullptr);
 /**
@@ -282,6 +310,15 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                         bool* pfMissingInputs, std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee, bool test_accept=false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/** (try to) add a batch of transactions to memory pool, in order
+ * The signatures of the batch are first verified on the script check threads,
+ * which fills the signature cache for the checks of the transactions as they
+ * are accepted one by one. The accept result of each transaction is returned,
+ * and states and pvMissingInputs (if not null) are filled in per transaction. **/
+std::vector<bool> AcceptToMemoryPoolBatch(CTxMemPool& pool, std::vector<CValidationState>& states, const std::vector<CTransactionRef>& txs,
+                        std::vector<bool>* pvMissingInputs, std::list<CTransactionRef>* plTxnReplaced,
+                        bool bypass_limits, const CAmount nAbsurdFee) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /** Get the BIP9 state for a given deployment at the current tip. */
 ThresholdState VersionBitsTipState(const Consensus::Params& params, Consensus::DeploymentPos pos);
 
@@ -368,6 +405,8 @@ bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::P
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
+/** Remove the witness data from a serialized block in place, without deserializing it. Returns false if the block cannot be parsed. */
+bool StripRawBlockWitness(std::vector<uint8_t>& block);
 
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
 
@@ -511,6 +550,8 @@ public:
     //! @see CChain, CBlockIndex.
     CChain m_chain;
     BlockMap mapBlockIndex GUARDED_BY(cs_main);
+    //! Storage of the entries in mapBlockIndex.
+    CBlockIndexArena m_block_index_arena GUARDED_BY(cs_main);
     std::multimap<CBlockIndex*, CBlockIndex*> mapBlocksUnlinked;
     CBlockIndex *pindexBestInvalid = nullptr;
 
@@ -617,6 +658,9 @@ CChain& ChainActive();
 /** Global variable that points to the coins database (protected by cs_main) */
 extern std::unique_ptr<CCoinsViewDB> pcoinsdbview;
 
+/** The layer between the coins database and the views on top of it that writes to the database in the background */
+extern CCoinsViewFlusher g_coins_flusher;
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern std::unique_ptr<CCoinsViewCache> pcoinsTip;
 